@@ -23,10 +23,16 @@
 #ifndef RPIHWCTRL_INTERFACES_OBSERVABLE_H
 #define RPIHWCTRL_INTERFACES_OBSERVABLE_H
 
-#include <map>
+#include <vector>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
 #include <functional>
+#include <semaphore.h>
 #include <RPiHWCtrl/Interfaces/Observer.h>
+#include <RPiHWCtrl/utils/SpscRing.h>
 
 namespace RPiHWCtrl {
 
@@ -40,6 +46,20 @@ namespace RPiHWCtrl {
  * every time they want to generate an event of type T. The Observable has the
  * logic of keeping and notifying the observers already implemented.
  * 
+ * By default the observers are notified synchronously, at the thread calling
+ * the notifyObservers(). Alternatively, the asynchronous delivery can be
+ * enabled with the enableAsyncDelivery() method. In this case the events are
+ * pushed in a bounded lock-free queue and a dedicated thread notifies the
+ * observers, so slow observers do not delay the thread generating the events.
+ * 
+ * The observers can be added and removed from any thread, even while events
+ * are delivered. Every modification publishes a new immutable list of the
+ * observers, so notifying them does not need any lock. For this reason the
+ * events of an Observable must always be generated from a single thread at a
+ * time. Observers can generate nested events of the same Observable only with
+ * the synchronous delivery, because with the asynchronous one they run at the
+ * delivery thread.
+ * 
  * @tparam T
  *    The type of the event
  */
@@ -48,7 +68,25 @@ class Observable {
   
 public:
   
-  virtual ~Observable() = default;
+  virtual ~Observable() {
+    disableAsyncDelivery();
+  }
+  
+  Observable() = default;
+  
+  /// Moves the observers and the asynchronous delivery (with its thread) to
+  /// the new object. The events must not be generated while moving.
+  Observable(Observable&&) = default;
+  
+  /// Stops the asynchronous delivery of this object (if enabled) before the
+  /// state of the other object is moved in it
+  Observable& operator=(Observable&& other) {
+    if (this != &other) {
+      disableAsyncDelivery();
+      m_registry = std::move(other.m_registry);
+    }
+    return *this;
+  }
   
   /**
    * @brief Adds an observer, which will be notified for future events
@@ -63,9 +101,12 @@ public:
    *    The identifier of the observer
    */
   int addObserver(std::shared_ptr<Observer<T>> observer) {
-    ++m_next_id;
-    m_observers[m_next_id] = observer;
-    return m_next_id;
+    std::lock_guard<std::mutex> lock {m_registry->mutex};
+    int id = ++m_registry->next_id;
+    auto observers = std::make_unique<ObserverList>(*m_registry->current);
+    observers->emplace_back(id, std::move(observer));
+    m_registry->publish(std::move(observers));
+    return id;
   }
   
   /**
@@ -86,24 +127,281 @@ public:
     return addObserver(std::make_shared<FunctionObserver>(observer));
   }
   
-  /// Removes the given observer from getting notifications
+  /// Removes the given observer from getting notifications. If it is called
+  /// while the observers are notified, the observer might still receive the
+  /// event being delivered.
   void removeObserver(int observer_id) {
-    m_observers.erase(observer_id);
+    std::lock_guard<std::mutex> lock {m_registry->mutex};
+    auto observers = std::make_unique<ObserverList>();
+    for (auto& entry : *m_registry->current) {
+      if (entry.first != observer_id) {
+        observers->push_back(entry);
+      }
+    }
+    m_registry->publish(std::move(observers));
+  }
+  
+  /**
+   * @brief Enables the asynchronous notification of the observers
+   * 
+   * @details
+   * After this call the notifyObservers() only pushes the event in a queue,
+   * without blocking or allocating memory, and the observers are notified from
+   * a dedicated thread. If the queue is full the event is dropped and the
+   * overflow counter is increased. If the asynchronous delivery is already
+   * enabled the call does nothing.
+   * 
+   * The delivery mode can be changed while events are generated. The switch
+   * waits for the event being notified to finish, so the observers are never
+   * called from two threads at the same time. An event generated while the
+   * asynchronous delivery is being disabled might be dropped. The method must
+   * not be called from an observer.
+   * 
+   * @param capacity
+   *    The maximum number of events waiting to be delivered
+   */
+  void enableAsyncDelivery(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock {m_registry->async_mutex};
+    if (m_registry->async.load() != nullptr) {
+      return;
+    }
+    auto async = std::make_unique<AsyncDelivery>(capacity);
+    m_registry->async.store(async.get());
+    // An event which was generated before the switch might still be notified
+    // synchronously. We let it finish before we start the delivery thread, so
+    // the observers are never called from two threads at the same time.
+    m_registry->waitForProducer();
+    try {
+      async->thread = std::thread {&Observable::deliverAsync, async.get(), m_registry.get()};
+    } catch (...) {
+      m_registry->async.store(nullptr);
+      m_registry->waitForProducer();
+      throw;
+    }
+    async.release();
+  }
+  
+  /// Stops the asynchronous notification of the observers. The events already
+  /// in the queue are delivered before the method returns. It must not be
+  /// called from an observer.
+  void disableAsyncDelivery() {
+    // A moved object has nothing to stop
+    if (m_registry == nullptr) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock {m_registry->async_mutex};
+    AsyncDelivery* async = m_registry->async.load();
+    if (async == nullptr) {
+      return;
+    }
+    // We stop the delivery thread before we switch to synchronous delivery, so
+    // the observers are never called from two threads at the same time
+    async->stop = true;
+    sem_post(&async->pending);
+    async->thread.join();
+    // A producer which loaded the delivery state before the switch might still
+    // push to it, so we wait for it to leave before we delete the state
+    m_registry->async.store(nullptr);
+    m_registry->waitForProducer();
+    delete async;
+  }
+  
+  /// Returns the number of events waiting to be delivered asynchronously
+  std::size_t asyncQueueDepth() const {
+    std::lock_guard<std::mutex> lock {m_registry->async_mutex};
+    auto async = m_registry->async.load();
+    return (async != nullptr) ? async->queue.size() : 0;
+  }
+  
+  /// Returns the number of events dropped because the asynchronous delivery
+  /// queue was full
+  std::uint64_t asyncOverflowCount() const {
+    std::lock_guard<std::mutex> lock {m_registry->async_mutex};
+    auto async = m_registry->async.load();
+    return (async != nullptr) ? async->overflows.load() : 0;
   }
   
 protected:
   
   /// Method to be called by the implementations to generate events of type T
   void notifyObservers(const T& value) {
-    for (auto& obs : m_observers) {
-      obs.second->event(value);
+    // Mark that we are using the delivery state, so it is not deleted before
+    // we are done with it
+    ProducerMark mark {m_registry->producing};
+    AsyncDelivery* async = m_registry->async.load();
+    if (async != nullptr) {
+      // Post the semaphore only if the event was queued, so the delivery thread
+      // wakes up once per event
+      if (async->queue.tryPush(value)) {
+        sem_post(&async->pending);
+      } else {
+        async->overflows.fetch_add(1, std::memory_order_relaxed);
+      }
+      return;
     }
+    m_registry->dispatch(value, Registry::PRODUCER);
   }
   
 private:
   
-  int m_next_id = 0;
-  std::map<int, std::shared_ptr<Observer<T>>> m_observers {};
+  using ObserverList = std::vector<std::pair<int, std::shared_ptr<Observer<T>>>>;
+  
+  struct AsyncDelivery;
+  
+  // Sets the producer flag for as long as it exists, even if an observer
+  // throws. Nested events of the observers find the flag already set and
+  // leave it to the outer event.
+  struct ProducerMark {
+    ProducerMark(std::atomic<bool>& producing)
+            : producing(producing), nested(producing.load(std::memory_order_relaxed)) {
+      if (!nested) {
+        producing.store(true);
+      }
+    }
+    ~ProducerMark() {
+      if (!nested) {
+        producing.store(false, std::memory_order_release);
+      }
+    }
+    std::atomic<bool>& producing;
+    bool nested;
+  };
+  
+  // Keeps the list of the observers. The current list is never modified. The
+  // modifications create a new list and publish it with an atomic store. The
+  // threads notifying the observers mark the list they use in their hazard
+  // slot, so the list is not deleted while it is used. The producer thread and
+  // the delivery thread have separate slots, and a slot which is already set
+  // means that an observer of the same thread generated a nested event. The state of the asynchronous
+  // delivery is published the same way, and the producer flag protects it
+  // while an event is generated.
+  struct Registry {
+    
+    Registry() {
+      owned.push_back(std::make_unique<ObserverList>());
+      current = owned.back().get();
+    }
+    
+    // The hazard slots of the threads notifying the observers
+    enum Slot {
+      PRODUCER, DELIVERY
+    };
+    
+    // Waits until the thread generating the events finishes the event it is
+    // generating, so it no longer uses the state of the asynchronous delivery
+    // it loaded before the state was replaced. Must be called with the
+    // async_mutex locked, after the state is replaced.
+    void waitForProducer() {
+      while (producing.load()) {
+        std::this_thread::yield();
+      }
+    }
+    
+    // Must be called with the mutex locked
+    void publish(std::unique_ptr<ObserverList> observers) {
+      current = observers.get();
+      owned.push_back(std::move(observers));
+      // Delete all the old lists which are not in use by the notifying threads
+      const ObserverList* producer_list = hazards[PRODUCER].load();
+      const ObserverList* delivery_list = hazards[DELIVERY].load();
+      for (auto it = owned.begin(); it != owned.end();) {
+        if (it->get() != current && it->get() != producer_list
+            && it->get() != delivery_list) {
+          it = owned.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    
+    void dispatch(const T& value, Slot slot) {
+      // If the hazard slot of the thread is already set, an observer generated
+      // a nested event, so we use the list which is already protected
+      auto& hazard = hazards[slot];
+      const ObserverList* observers = hazard.load(std::memory_order_relaxed);
+      if (observers != nullptr) {
+        notify(*observers, value);
+        return;
+      }
+      // Protect the list before we use it, and check that it was not replaced
+      // before the protection was visible
+      observers = current.load();
+      for (;;) {
+        hazard.store(observers);
+        const ObserverList* again = current.load();
+        if (again == observers) {
+          break;
+        }
+        observers = again;
+      }
+      // Release the protection even if an observer throws
+      struct HazardReset {
+        std::atomic<const ObserverList*>& hazard;
+        ~HazardReset() {
+          hazard.store(nullptr, std::memory_order_release);
+        }
+      } reset {hazard};
+      notify(*observers, value);
+    }
+    
+    static void notify(const ObserverList& observers, const T& value) {
+      for (auto& obs : observers) {
+        obs.second->event(value);
+      }
+    }
+    
+    std::mutex mutex {};
+    // Serializes enabling and disabling the asynchronous delivery
+    mutable std::mutex async_mutex {};
+    std::atomic<AsyncDelivery*> async {nullptr};
+    // Set while the thread generating the events uses the async state
+    std::atomic<bool> producing {false};
+    int next_id = 0;
+    std::atomic<const ObserverList*> current {nullptr};
+    std::atomic<const ObserverList*> hazards[2] {{nullptr}, {nullptr}};
+    std::vector<std::unique_ptr<ObserverList>> owned {};
+    
+  };
+
+  
+  // The state of the asynchronous delivery. The semaphore counts the events in
+  // the queue, plus one when the delivery is stopped. Posting a semaphore never
+  // blocks, so it is safe to use from the producer thread.
+  struct AsyncDelivery {
+    AsyncDelivery(std::size_t capacity) : queue(capacity) {
+      sem_init(&pending, 0, 0);
+    }
+    ~AsyncDelivery() {
+      sem_destroy(&pending);
+    }
+    SpscRing<T> queue;
+    sem_t pending;
+    std::atomic<bool> stop {false};
+    std::atomic<std::uint64_t> overflows {0};
+    std::thread thread {};
+  };
+  
+  static void deliverAsync(AsyncDelivery* async, Registry* registry) {
+    T value;
+    for (;;) {
+      while (sem_wait(&async->pending) != 0) {
+        // Interrupted by a signal, so we wait again
+      }
+      if (async->stop) {
+        // We deliver the events queued before we were asked to stop. The
+        // producer may still push a few more, which are dropped.
+        for (auto count = async->queue.size(); count > 0 && async->queue.tryPop(value); --count) {
+          registry->dispatch(value, Registry::DELIVERY);
+        }
+        break;
+      }
+      if (async->queue.tryPop(value)) {
+        registry->dispatch(value, Registry::DELIVERY);
+      }
+    }
+  }
+  
+  std::unique_ptr<Registry> m_registry = std::make_unique<Registry>();
   
   // This is a helper adaptor which converts a functor to an Observer 
   class FunctionObserver : public Observer<T> {
@@ -24,8 +24,12 @@
 #define RPIHWCTRL_INTERFACES_EXCEPTIONS_H
 
 #include <exception>
+#include <mutex>
 #include <sstream>
 #include <type_traits>
+#include <string>
+#include <cerrno>
+#include <cstdint>
 #include <cstring>
 
 namespace RPiHWCtrl {
@@ -34,20 +38,68 @@ class Exception : public std::exception {
   
 public:
   
+  Exception() = default;
+  
+  /// The message of the copy is formatted, so the two objects do not share
+  /// any lazy state
+  Exception(const Exception& other) : std::exception(other) {
+    m_message = other.what();
+    std::call_once(m_format_once, []() {});
+  }
+  
+  Exception& operator=(const Exception& other) {
+    if (this != &other) {
+      std::exception::operator=(other);
+      m_message = other.what();
+      std::call_once(m_format_once, []() {});
+    }
+    return *this;
+  }
+  
   const char * what() const noexcept override {
+    // The message of the subclass is formatted only the first time it is
+    // needed, so exceptions which are caught and handled never format it. The
+    // same exception can be rethrown in many threads (for example from the
+    // futures of a failed I2CRequestQueue batch), so the formatting is done
+    // only once.
+    try {
+      std::call_once(m_format_once, [this]() {
+        std::string message {};
+        formatMessage(message);
+        m_message.insert(0, message);
+      });
+    } catch (...) {
+    }
     return m_message.c_str();
   }
   
+  void appendMessage(const std::string& message) {
+    m_message += message;
+  }
+  
+  void appendMessage(const char* message) {
+    m_message += message;
+  }
+  
   template <typename T>
   void appendMessage(const T& message) {
-    std::stringstream new_message;
-    new_message << m_message << message;
-    m_message = new_message.str();
+    std::ostringstream new_message;
+    new_message << message;
+    m_message += new_message.str();
+  }
+  
+protected:
+  
+  /// Called by the first what() to format the part of the message which is
+  /// built from the members of the exception. Any text added with
+  /// appendMessage() follows it.
+  virtual void formatMessage(std::string&) const {
   }
   
 private:
   
-  std::string m_message {};
+  mutable std::string m_message {};
+  mutable std::once_flag m_format_once {};
   
 };
 
@@ -79,6 +131,9 @@ public:
   int gpio;
 };
 
+class PwmException : public Exception {
+};
+
 class I2CException : public Exception {
 };
 
@@ -94,15 +149,18 @@ public:
 
 class I2CDeviceConnectionFailure : public I2CException {
 public:
-  I2CDeviceConnectionFailure(int address) : address(address), err_code(errno) {
-    appendMessage("Failed to connect to I2C address ");
-    std::stringstream address_str;
-    address_str << std::hex << address;
-    appendMessage(address_str.str() + ": ");
-    appendMessage(std::strerror(err_code));
+  I2CDeviceConnectionFailure(int address, int err_code=errno)
+          : address(address), err_code(err_code) {
   }
   int address;
   int err_code;
+protected:
+  void formatMessage(std::string& message) const override {
+    std::stringstream address_str;
+    address_str << "Failed to connect to I2C address " << std::hex << address
+                << ": " << std::strerror(err_code);
+    message = address_str.str();
+  }
 };
 
 class I2CActionOutOfTransaction : public I2CException {
@@ -110,32 +168,62 @@ class I2CActionOutOfTransaction : public I2CException {
 
 class I2CReadRegisterException : public I2CException {
 public:
-  I2CReadRegisterException(std::int8_t register_address) 
-          : register_address(register_address), err_code(errno) {
-    appendMessage("Failed to read register ");
-    std::stringstream address_str;
-    address_str << std::hex << (int)register_address;
-    appendMessage(address_str.str() + ": ");
-    appendMessage(std::strerror(err_code));
+  I2CReadRegisterException(std::int8_t register_address, int err_code=errno) 
+          : register_address(register_address), err_code(err_code) {
   }
   std::int8_t register_address;
   int err_code;
+protected:
+  void formatMessage(std::string& message) const override {
+    std::stringstream address_str;
+    address_str << "Failed to read register " << std::hex << (int)register_address
+                << ": " << std::strerror(err_code);
+    message = address_str.str();
+  }
 };
 
 template <typename T>
 class I2CWriteRegisterException : public I2CException {
 public:
-  I2CWriteRegisterException(std::int8_t register_address, T value)
-          : register_address(register_address), err_code(errno), value(value) {
-    std::stringstream message;
-    message << "Failed to write " << value << " in register "
-            << (int)register_address << ": ";
-    appendMessage(message.str());
-    appendMessage(std::strerror(err_code));
+  I2CWriteRegisterException(std::int8_t register_address, T value, int err_code=errno)
+          : register_address(register_address), err_code(err_code), value(value) {
   }
   std::int8_t register_address;
   int err_code;
   T value;
+protected:
+  void formatMessage(std::string& message) const override {
+    std::stringstream message_str;
+    message_str << "Failed to write " << value << " in register "
+                << (int)register_address << ": " << std::strerror(err_code);
+    message = message_str.str();
+  }
+};
+
+class I2CTransferException : public I2CException {
+public:
+  I2CTransferException(std::size_t operations, int register_address=-1, bool write=false,
+                       int err_code=errno)
+          : operations(operations), register_address(register_address), write(write),
+            err_code(err_code) {
+  }
+  std::size_t operations;
+  /// The first register of the operation which failed, or -1 if unknown
+  int register_address;
+  /// If the operation which failed is a write
+  bool write;
+  int err_code;
+protected:
+  void formatMessage(std::string& message) const override {
+    std::stringstream message_str;
+    message_str << "Failed to transfer " << operations << " I2C operations";
+    if (register_address >= 0) {
+      message_str << (write ? " (write" : " (read") << " of register "
+                  << std::hex << register_address << ")";
+    }
+    message_str << ": " << std::strerror(err_code);
+    message = message_str.str();
+  }
 };
 
 class I2CWrongModule : public I2CException {
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file ChardevGpioDriver.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_CHARDEVGPIODRIVER_H
+#define RPIHWCTRL_GPIO_CHARDEVGPIODRIVER_H
+
+#include <string>
+#include <RPiHWCtrl/gpio/GpioDriver.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class ChardevGpioDriver
+ *
+ * @brief GpioDriver using the GPIO character device (v2 uAPI) of the kernel
+ *
+ * @details
+ * All the lines of a requestLines() call are reserved with a single line
+ * request, so they can be read or written all together with a single ioctl()
+ * call. Edge events are read from the file descriptor of the line request.
+ *
+ * The GPIO numbers are the line offsets of the chip, which for the gpiochip0
+ * of the Raspberry Pi are the same with the BCM GPIO numbers. For testing,
+ * the driver can be used with the chips created by the gpio-sim kernel module.
+ */
+class ChardevGpioDriver : public GpioDriver {
+
+public:
+
+  /// The default GPIO chip device
+  static constexpr const char* default_chip = "/dev/gpiochip0";
+
+  /**
+   * @brief Creates a driver for the given GPIO chip
+   *
+   * @param chip_path
+   *    The path of the GPIO chip device
+   *
+   * @throws GpioException
+   *    If the chip device cannot be opened
+   */
+  ChardevGpioDriver(const std::string& chip_path = default_chip);
+
+  ChardevGpioDriver(const ChardevGpioDriver&) = delete;
+  ChardevGpioDriver& operator=(const ChardevGpioDriver&) = delete;
+
+  /// Closes the chip device. Lines already requested stay reserved.
+  virtual ~ChardevGpioDriver();
+
+  std::unique_ptr<GpioLines> requestLines(const std::vector<int>& gpios,
+                                          GpioDirection direction) override;
+
+private:
+
+  std::string m_chip_path;
+  int m_chip_fd;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_CHARDEVGPIODRIVER_H
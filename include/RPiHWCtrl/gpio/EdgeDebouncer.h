@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file EdgeDebouncer.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_EDGEDEBOUNCER_H
+#define RPIHWCTRL_GPIO_EDGEDEBOUNCER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <RPiHWCtrl/gpio/EdgeEvent.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class EdgeDebouncer
+ *
+ * @brief User space filter which removes the bouncing of a GPIO input
+ *
+ * @details
+ * The filter is driven by the timestamps of the edge events. An edge is
+ * considered settled when no other edge follows it for the debounce period.
+ * A settled edge is reported only if it changes the last reported value, so
+ * short glitches are removed completely. All the other edges are counted as
+ * suppressed.
+ *
+ * The edges must be given with the onEdge() method and the settle() method
+ * must be called when the deadline() is reached. All the methods, except of
+ * the counters, must be called from the same thread.
+ */
+class EdgeDebouncer {
+
+public:
+
+  /// Creates a filter with the given debounce period
+  EdgeDebouncer(std::chrono::nanoseconds period) : m_period(period.count()) {
+  }
+
+  /// Discards any pending edge and sets the value the filter starts from
+  void reset(bool value) {
+    m_value = value;
+    m_has_pending = false;
+  }
+
+  /// Adds a new edge to the filter. Any pending edge which did not settle yet
+  /// is suppressed.
+  void onEdge(const EdgeEvent& event) {
+    if (m_has_pending) {
+      m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_pending = event;
+    m_has_pending = true;
+  }
+
+  /// Returns the time (in nanoseconds of CLOCK_MONOTONIC) the pending edge
+  /// settles, or zero if there is no pending edge
+  std::uint64_t deadline() const {
+    return m_has_pending ? m_pending.timestamp_ns + m_period : 0;
+  }
+
+  /**
+   * @brief Checks if the pending edge has settled
+   *
+   * @param now_ns
+   *    The current time, in nanoseconds of CLOCK_MONOTONIC
+   * @param settled
+   *    Set to the settled edge if it should be reported
+   * @return
+   *    True if there is a settled edge to report
+   */
+  bool settle(std::uint64_t now_ns, EdgeEvent& settled) {
+    if (!m_has_pending || now_ns < deadline()) {
+      return false;
+    }
+    m_has_pending = false;
+    bool value = (m_pending.type == EdgeEvent::Type::RISING);
+    if (value == m_value) {
+      // The input returned to the value it had, so this was a glitch
+      m_suppressed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    m_value = value;
+    m_accepted.fetch_add(1, std::memory_order_relaxed);
+    settled = m_pending;
+    return true;
+  }
+
+  /// Returns the number of the edges removed by the filter
+  std::uint64_t suppressedEdges() const {
+    return m_suppressed.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the number of the edges which passed the filter
+  std::uint64_t acceptedEdges() const {
+    return m_accepted.load(std::memory_order_relaxed);
+  }
+
+private:
+
+  std::uint64_t m_period;
+  bool m_value = false;
+  bool m_has_pending = false;
+  EdgeEvent m_pending {};
+  std::atomic<std::uint64_t> m_suppressed {0};
+  std::atomic<std::uint64_t> m_accepted {0};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_EDGEDEBOUNCER_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file EdgeEvent.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_EDGEEVENT_H
+#define RPIHWCTRL_GPIO_EDGEEVENT_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace RPiHWCtrl {
+
+/**
+ * @struct EdgeEvent
+ *
+ * @brief An edge detected on a GPIO line
+ *
+ * @details
+ * With the character device driver the sequence number is assigned by the
+ * kernel and increased by one for every edge detected on the line, so a gap
+ * between the sequence numbers of two consecutive events means that the events
+ * in between were lost. The sysfs driver cannot detect lost edges, so its
+ * sequence numbers never have gaps.
+ */
+struct EdgeEvent {
+
+  enum class Type {
+    RISING, FALLING
+  };
+
+  /// The type of the edge
+  Type type;
+
+  /// The time the edge was detected, in nanoseconds of CLOCK_MONOTONIC. With the
+  /// character device driver this is the kernel timestamp of the interrupt.
+  /// The sysfs driver can only provide the time the event was read.
+  std::uint64_t timestamp_ns;
+
+  /// The sequence number of the event on its line. Gaps mean lost events only
+  /// with the character device driver. The sysfs driver numbers the events it
+  /// reads (a synthetic counter), and it takes their type from the current
+  /// value, so edges which were collapsed or lost leave no trace.
+  std::uint32_t seqno;
+
+  /// The index of the line in the GpioLines the event was read from
+  std::size_t line;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_EDGEEVENT_H
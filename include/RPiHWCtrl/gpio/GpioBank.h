@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file GpioBank.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_GPIOBANK_H
+#define RPIHWCTRL_GPIO_GPIOBANK_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <RPiHWCtrl/Interfaces/Input.h>
+#include <RPiHWCtrl/Interfaces/Output.h>
+#include <RPiHWCtrl/gpio/GpioDriver.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class GpioBank
+ *
+ * @brief Class for accessing a group of GPIOs all together
+ *
+ * @details
+ * The values of the GPIOs of the bank are represented as a bitmask, where the
+ * bit i corresponds to the i-th GPIO of the list given to the constructor.
+ * When the driver supports it (for example the ChardevGpioDriver), reading and
+ * writing the bank is performed with a single call to the driver, so all the
+ * GPIOs change state at the same time. With the sysfs driver the GPIOs are
+ * accessed one by one.
+ *
+ * The class implements the Input<std::uint64_t> and Output<std::uint64_t>
+ * interfaces, which read and write all the GPIOs of the bank.
+ */
+class GpioBank : public Input<std::uint64_t>, public Output<std::uint64_t> {
+
+public:
+
+  /**
+   * @brief Creates a GpioBank for the requested pins, using the default sysfs
+   * driver
+   *
+   * @param gpios
+   *    The numbers of the GPIOs of the bank (maximum 64)
+   * @param direction
+   *    The direction of all the GPIOs of the bank
+   *
+   * @throws GpioAlreadyResearved
+   *    If any of the requested GPIOs is already reserved
+   * @throws BadGpioNumber
+   *    If any of the given numbers is out of the range 2-27
+   * @throws GpioException
+   *    If there was any problem with the communication with the driver
+   */
+  GpioBank(const std::vector<int>& gpios, GpioDirection direction=GpioDirection::OUTPUT);
+
+  /**
+   * @brief Creates a GpioBank for the requested pins, using the given driver
+   *
+   * @param gpios
+   *    The numbers of the GPIOs of the bank (maximum 64)
+   * @param driver
+   *    The driver to use for accessing the GPIOs
+   * @param direction
+   *    The direction of all the GPIOs of the bank
+   *
+   * @throws GpioAlreadyResearved
+   *    If any of the requested GPIOs is already reserved
+   * @throws BadGpioNumber
+   *    If any of the given numbers is out of the range 2-27
+   * @throws GpioException
+   *    If there was any problem with the communication with the driver
+   */
+  GpioBank(const std::vector<int>& gpios, std::shared_ptr<GpioDriver> driver,
+           GpioDirection direction=GpioDirection::OUTPUT);
+
+  GpioBank(const GpioBank&) = delete;
+  GpioBank& operator=(const GpioBank&) = delete;
+  GpioBank(GpioBank&&) = default;
+  GpioBank& operator=(GpioBank&&) = default;
+
+  /// Releases the physical GPIOs
+  virtual ~GpioBank() = default;
+
+  /// Returns the number of the GPIOs of the bank
+  std::size_t size() const {
+    return m_gpios.size();
+  }
+
+  /// Returns the numbers of the GPIOs of the bank, in the order of the bits
+  const std::vector<int>& gpios() const {
+    return m_gpios;
+  }
+
+  /// Returns a mask with the bits of all the GPIOs of the bank set
+  std::uint64_t fullMask() const {
+    return (m_gpios.size() == 64) ? ~std::uint64_t{0}
+                                  : (std::uint64_t{1} << m_gpios.size()) - 1;
+  }
+
+  /// Returns the values of all the GPIOs of the bank
+  std::uint64_t readAll() {
+    return m_lines->readValues(fullMask());
+  }
+
+  /// Sets the GPIOs selected by the mask to the respective bits of the values.
+  /// The rest of the GPIOs are not modified.
+  void writeMask(std::uint64_t mask, std::uint64_t values) {
+    m_lines->writeValues(mask & fullMask(), values);
+  }
+
+  /// Same as readAll()
+  std::uint64_t readValue() override {
+    return readAll();
+  }
+
+  /// Sets all the GPIOs of the bank to the respective bits of the value
+  void writeValue(const std::uint64_t& value) override {
+    writeMask(fullMask(), value);
+  }
+
+private:
+
+  std::vector<int> m_gpios;
+  std::unique_ptr<GpioLines> m_lines;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_GPIOBANK_H
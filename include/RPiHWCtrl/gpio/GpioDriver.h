@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file GpioDriver.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_GPIODRIVER_H
+#define RPIHWCTRL_GPIO_GPIODRIVER_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <RPiHWCtrl/gpio/EdgeEvent.h>
+
+namespace RPiHWCtrl {
+
+/// The direction in which a GPIO line is used
+enum class GpioDirection {
+  INPUT, OUTPUT
+};
+
+/**
+ * @class GpioLines
+ *
+ * @brief Handle to a set of GPIO lines reserved from a GpioDriver
+ *
+ * @details
+ * The lines are released when the handle is destroyed. The values of the lines
+ * are represented as bitmasks, where the bit i corresponds to the i-th GPIO of
+ * the list the lines were requested with. Implementations should perform the
+ * operations on all the lines with as few calls to the driver as they can.
+ */
+class GpioLines {
+
+public:
+
+  virtual ~GpioLines() = default;
+
+  /// Returns the number of the lines handled
+  virtual std::size_t size() const = 0;
+
+  /// Returns the values of the lines selected by the mask
+  virtual std::uint64_t readValues(std::uint64_t mask) = 0;
+
+  /// Sets the lines selected by the mask to the respective bits of the values
+  virtual void writeValues(std::uint64_t mask, std::uint64_t values) = 0;
+
+  /// Returns the file descriptor to poll for edge events, or -1 if edge events
+  /// are not supported
+  virtual int eventFd() const = 0;
+
+  /// Returns the poll() event flags which signal an edge on the eventFd()
+  virtual short eventPollFlags() const = 0;
+
+  /**
+   * @brief Reads the pending edge events, after eventFd() signaled them
+   *
+   * @details
+   * The events are read in a single call to the driver, if it supports it.
+   * The method blocks if there is no pending event.
+   *
+   * @param events
+   *    The buffer to read the events in
+   * @param max_events
+   *    The size of the buffer. It must be at least one.
+   * @return
+   *    The number of the events read
+   */
+  virtual std::size_t readEvents(EdgeEvent* events, std::size_t max_events) = 0;
+
+  /// Discards all the pending edge events
+  virtual void clearEvents() = 0;
+
+  /**
+   * @brief Asks the driver to debounce the edges of the lines
+   *
+   * @details
+   * The default implementation does nothing and returns false, for the drivers
+   * which cannot debounce the lines.
+   *
+   * @param period
+   *    The time the lines must be stable before an edge is reported. Zero
+   *    disables the debouncing.
+   * @return
+   *    True if the driver debounces the lines
+   */
+  virtual bool setDebounce(std::chrono::microseconds period) {
+    (void) period;
+    return false;
+  }
+
+};
+
+/**
+ * @class GpioDriver
+ *
+ * @brief Interface of the kernel interfaces which can be used for accessing
+ * the GPIOs
+ *
+ * @details
+ * The GpioInput and GpioOutput classes are using a GpioDriver to reserve the
+ * GPIO lines they control, which allows for selecting the kernel interface at
+ * construction time.
+ */
+class GpioDriver {
+
+public:
+
+  virtual ~GpioDriver() = default;
+
+  /**
+   * @brief Reserves the given GPIOs for using them in the given direction
+   *
+   * @param gpios
+   *    The numbers of the GPIOs to reserve (maximum 64)
+   * @param direction
+   *    The direction to configure the lines with. Lines configured as inputs
+   *    also detect both rising and falling edges.
+   * @return
+   *    A handle to the reserved lines
+   *
+   * @throws GpioAlreadyReserved
+   *    If any of the GPIOs is already reserved
+   * @throws GpioException
+   *    If there was any problem with the communication with the driver
+   */
+  virtual std::unique_ptr<GpioLines> requestLines(const std::vector<int>& gpios,
+                                                  GpioDirection direction) = 0;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_GPIODRIVER_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file GpioEventReactor.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_GPIOEVENTREACTOR_H
+#define RPIHWCTRL_GPIO_GPIOEVENTREACTOR_H
+
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+#include <RPiHWCtrl/gpio/GpioDriver.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class GpioEventReactor
+ *
+ * @brief Single thread waiting for the edge events of many GPIO lines
+ *
+ * @details
+ * The reactor watches the event file descriptors of all the registered lines
+ * with a single epoll set and calls the handler of a line from its thread when
+ * the line has a pending event. The thread sleeps until an event occurs, so
+ * there are no wakeups while the lines are idle. All the started GpioInput
+ * instances share the reactor returned by getSingleton().
+ */
+class GpioEventReactor {
+
+public:
+
+  /// Returns the reactor shared by all the GpioInput instances
+  static std::shared_ptr<GpioEventReactor> getSingleton();
+
+  /// Creates a reactor and starts its thread
+  GpioEventReactor();
+
+  GpioEventReactor(const GpioEventReactor&) = delete;
+  GpioEventReactor& operator=(const GpioEventReactor&) = delete;
+
+  /// Stops the reactor thread
+  virtual ~GpioEventReactor();
+
+  /**
+   * @brief Starts watching the given lines for edge events
+   *
+   * @details
+   * The handler is called from the reactor thread every time the eventFd() of
+   * the lines signals an event, and it must consume the event. Handlers of
+   * different lines are called sequentially, so they should return quickly.
+   *
+   * @throws GpioException
+   *    If the lines do not support edge events or are already watched
+   */
+  void add(GpioLines& lines, std::function<void()> handler);
+
+  /**
+   * @brief Starts watching a file descriptor
+   *
+   * @details
+   * This is the same as the add() for lines, but for any file descriptor
+   * supported by epoll (for example a timerfd used together with the lines).
+   *
+   * @param fd
+   *    The file descriptor to watch
+   * @param events
+   *    The epoll events to wait for
+   * @param handler
+   *    The handler which must consume the events of the file descriptor
+   *
+   * @throws GpioException
+   *    If the file descriptor is already watched or cannot be watched
+   */
+  void add(int fd, std::uint32_t events, std::function<void()> handler);
+
+  /**
+   * @brief Stops watching the given lines
+   *
+   * @details
+   * When the method returns the handler of the lines is not running and it
+   * will not be called again. It is safe to call this method from the handler
+   * itself.
+   */
+  void remove(GpioLines& lines);
+
+  /// Stops watching the given file descriptor, with the same guarantees as the
+  /// remove() for lines
+  void remove(int fd);
+
+private:
+
+  struct Entry {
+    std::function<void()> handler;
+    bool removed;
+  };
+
+  void run();
+
+  int m_epoll_fd;
+  int m_wakeup_fd;
+  std::mutex m_mutex {};
+  std::condition_variable m_dispatch_done {};
+  std::map<int, Entry> m_entries {};
+  int m_dispatching_fd = -1;
+  bool m_stopping = false;
+  std::thread m_thread {};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_GPIOEVENTREACTOR_H
@@ -24,11 +24,16 @@
 #define RPIHWCTRL_GPIO_GPIOINPUT_H
 
 #include <string>
-#include <atomic>
-#include <thread>
+#include <chrono>
+#include <vector>
 #include <memory>
+#include <future>
+#include <exception>
 #include <RPiHWCtrl/Interfaces/Input.h>
 #include <RPiHWCtrl/Interfaces/Observable.h>
+#include <RPiHWCtrl/gpio/GpioDriver.h>
+#include <RPiHWCtrl/gpio/GpioEventReactor.h>
+#include <RPiHWCtrl/gpio/EdgeDebouncer.h>
 
 namespace RPiHWCtrl {
 
@@ -50,16 +55,29 @@ namespace RPiHWCtrl {
  * - blockUntilValueChange(): Blocks until the status of the GPIO is changed and
  *      returns the new status
  * - Via interrupts: By adding observers using the addObserver() and then
- *      calling the start() method.
+ *      calling the start() method. The observers are notified from the thread
+ *      of the GpioEventReactor, which is shared by all the GpioInputs.
  * 
- * Internally the class uses the linux driver via sysfs.
+ * The observers added to the edgeEvents() observable are notified with the
+ * details of each edge (type, timestamp and sequence number), which allows for
+ * detecting lost events with the ChardevGpioDriver (see EdgeEvent::seqno). The
+ * Observable<bool> observers get only the new value.
+ * 
+ * Inputs connected to mechanical switches can be debounced by using the
+ * setDebounce() method, in which case the observers are notified only for the
+ * edges after which the input was stable for the debounce period.
+ * 
+ * The kernel interface used for accessing the GPIO is selected at construction
+ * time by the GpioDriver given to the constructor. By default the sysfs
+ * interface is used (see SysfsGpioDriver).
  */
 class GpioInput : public Input<bool>, public Observable<bool> {
   
 public:
 
   /**
-   * @brief Creates a GpioInput for the requested pin
+   * @brief Creates a GpioInput for the requested pin, using the default sysfs
+   * driver
    * 
    * @param m_gpio_no
    *    The number of the GPIO to use as the input
@@ -73,10 +91,50 @@ public:
    */
   GpioInput(int m_gpio_no);
   
+  /**
+   * @brief Creates a GpioInput for the requested pin, using the given driver
+   * 
+   * @param m_gpio_no
+   *    The number of the GPIO to use as the input
+   * @param driver
+   *    The driver to use for accessing the GPIO
+   * 
+   * @throws GpioAlreadyResearved
+   *    If the requested GPIO is already reserved
+   * @throws BadGpioNumber
+   *    If the given number is out of the range 2-27
+   * @throws GpioException
+   *    If there was any problem with the communication with the driver
+   */
+  GpioInput(int m_gpio_no, std::shared_ptr<GpioDriver> driver);
+  
+  /**
+   * @brief Creates GpioInputs for many pins concurrently
+   * 
+   * @details
+   * The pins are set up in parallel, so the time needed does not grow with
+   * the number of the pins. If any of the pins fails, the ones already created
+   * are released and the first exception is rethrown.
+   * 
+   * @param gpio_numbers
+   *    The numbers of the GPIOs to use as inputs
+   * @param driver
+   *    The driver to use for accessing the GPIOs. If nullptr the default sysfs
+   *    driver is used.
+   * @return
+   *    The GpioInputs, in the order of the given GPIO numbers
+   */
+  static std::vector<GpioInput> createMany(const std::vector<int>& gpio_numbers,
+                                           std::shared_ptr<GpioDriver> driver=nullptr);
+  
   GpioInput(const GpioInput&) = delete;
   GpioInput& operator=(const GpioInput&) = delete;
-  GpioInput(GpioInput&&) = default;
-  GpioInput& operator=(GpioInput&&) = default;
+  
+  /// Moves the GPIO to a new object. If the other object is started, it is
+  /// stopped and the new object is started instead, so the reactor never
+  /// calls a moved object.
+  GpioInput(GpioInput&& other);
+  GpioInput& operator=(GpioInput&& other);
 
   /// Releases the physical GPIO
   virtual ~GpioInput();
@@ -85,25 +143,121 @@ public:
   /// and false otherwise
   bool readValue() override;
 
+  /// Returns the observable which notifies its observers for every edge event.
+  /// The events are generated after the start() method is called.
+  Observable<EdgeEvent>& edgeEvents() {
+    return m_edge_events;
+  }
+
   /// Blocks until the input changes and returns the new status
   bool blockUntilValueChange();
 
+  /**
+   * @brief Sets the debounce period of the input
+   * 
+   * @details
+   * When the debounce period is set, an edge is reported to the observers only
+   * if the input stays stable for the given period after it. If the driver can
+   * debounce the line (like the ChardevGpioDriver) and the prefer_driver is
+   * true the debouncing is done by the kernel. Otherwise a user space filter
+   * driven by the event timestamps is used. Note that the reported edges are
+   * delayed by the debounce period and that the sequence numbers of the edge
+   * events have gaps for the suppressed edges. The method must be called while
+   * the input is not started.
+   * 
+   * @param period
+   *    The debounce period. Zero disables the debouncing.
+   * @param prefer_driver
+   *    If true the driver debouncing is used, when available
+   */
+  void setDebounce(std::chrono::microseconds period, bool prefer_driver=true);
+  
+  /// Returns the number of the edges suppressed by the user space debounce
+  /// filter. The edges suppressed by the driver are not counted.
+  std::uint64_t suppressedEdges() const {
+    return (m_debouncer != nullptr) ? m_debouncer->suppressedEdges() : 0;
+  }
+
   /// Start listening for value changes interrupts and notify the observers
+  /// @throws GpioException If the driver does not support edge events
   void start();
 
-  /// Stop listening for interrupts
+  /// Stop listening for interrupts. When the method returns the observers
+  /// are not notified any more.
   void stop();
   
 protected:
   
-  std::string m_gpio_dir;
-  std::string m_value_file;
+  /// Reserves the GPIO from the driver, configured in the given direction
+  GpioInput(int m_gpio_no, std::shared_ptr<GpioDriver> driver, GpioDirection direction);
+  
+  std::unique_ptr<GpioLines> m_line;
+  
+  /// Creates objects of type Gpio (GpioInput or a subclass) concurrently, by
+  /// calling their (gpio_no, driver) constructor from different threads
+  template <typename Gpio>
+  static std::vector<Gpio> createConcurrently(const std::vector<int>& gpio_numbers,
+                                              std::shared_ptr<GpioDriver> driver) {
+    std::vector<std::future<Gpio>> futures {};
+    for (auto gpio_no : gpio_numbers) {
+      futures.push_back(std::async(std::launch::async, [gpio_no, driver]() {
+        return Gpio(gpio_no, driver);
+      }));
+    }
+    // We wait for all the threads to finish, even if some of them failed
+    std::vector<Gpio> result {};
+    result.reserve(gpio_numbers.size());
+    std::exception_ptr error {};
+    for (auto& future : futures) {
+      try {
+        result.push_back(future.get());
+      } catch (...) {
+        if (error == nullptr) {
+          error = std::current_exception();
+        }
+      }
+    }
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+    return result;
+  }
   
 private:
   
+  // Stops the input and returns if it was started. It is used for moving a
+  // started input, which has to be registered to the reactor again.
+  bool stopForMove();
+  
+  // The move constructor, which starts the new object if restart is true
+  GpioInput(GpioInput&& other, bool restart);
+  
+  // Helper class which allows us to notify the observers of the edge events
+  class EdgeEventObservable : public Observable<EdgeEvent> {
+  public:
+    using Observable<EdgeEvent>::notifyObservers;
+  };
+  
+  // Notifies the observers for the given event
+  void deliverEvent(const EdgeEvent& event);
+  
+  // Reads the pending events and passes them to the debounce filter
+  void debounceEvents();
+  
+  // Reports the edge of the debounce filter if it settled
+  void settleDebouncer();
+  
   int m_gpio_no;
-  std::unique_ptr<std::atomic<bool>> m_observing_flag = std::make_unique<std::atomic<bool>>(false);
-  std::unique_ptr<std::thread> m_observing_thread {};
+  std::shared_ptr<GpioEventReactor> m_reactor {};
+  EdgeEventObservable m_edge_events {};
+  
+  // The user space debounce filter and the timer firing when its pending edge
+  // settles. They are used only if the driver cannot debounce the line.
+  std::unique_ptr<EdgeDebouncer> m_debouncer {};
+  int m_debounce_timer_fd = -1;
+  
+  // Preallocated buffer where the events are read in batches
+  std::vector<EdgeEvent> m_event_buffer;
   
 };
 
@@ -45,7 +45,8 @@ class GpioOutput : public GpioInput, public Output<bool> {
 public:
   
   /**
-   * @brief Creates a GpioOutput for the requested pin
+   * @brief Creates a GpioOutput for the requested pin, using the default sysfs
+   * driver
    * 
    * @param m_gpio_no
    *    The number of the GPIO to use as the output
@@ -59,6 +60,42 @@ public:
    */
   GpioOutput(int m_gpio_no);
   
+  /**
+   * @brief Creates a GpioOutput for the requested pin, using the given driver
+   * 
+   * @param m_gpio_no
+   *    The number of the GPIO to use as the output
+   * @param driver
+   *    The driver to use for accessing the GPIO
+   * 
+   * @throws GpioAlreadyResearved
+   *    If the requested GPIO is already reserved
+   * @throws BadGpioNumber
+   *    If the given number is out of the range 2-27
+   * @throws GpioException
+   *    If there was any problem with the communication with the driver
+   */
+  GpioOutput(int m_gpio_no, std::shared_ptr<GpioDriver> driver);
+  
+  /**
+   * @brief Creates GpioOutputs for many pins concurrently
+   * 
+   * @details
+   * The pins are set up in parallel, so the time needed does not grow with
+   * the number of the pins. If any of the pins fails, the ones already created
+   * are released and the first exception is rethrown.
+   * 
+   * @param gpio_numbers
+   *    The numbers of the GPIOs to use as outputs
+   * @param driver
+   *    The driver to use for accessing the GPIOs. If nullptr the default sysfs
+   *    driver is used.
+   * @return
+   *    The GpioOutputs, in the order of the given GPIO numbers
+   */
+  static std::vector<GpioOutput> createMany(const std::vector<int>& gpio_numbers,
+                                            std::shared_ptr<GpioDriver> driver=nullptr);
+  
   GpioOutput(const GpioOutput&) = delete;
   GpioOutput& operator=(const GpioOutput&) = delete;
   GpioOutput(GpioOutput&&) = default;
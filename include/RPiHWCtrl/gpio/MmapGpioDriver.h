@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file MmapGpioDriver.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_MMAPGPIODRIVER_H
+#define RPIHWCTRL_GPIO_MMAPGPIODRIVER_H
+
+#include <string>
+#include <RPiHWCtrl/gpio/GpioDriver.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class MmapGpioDriver
+ *
+ * @brief GpioDriver accessing directly the GPIO registers of the BCM283x
+ *
+ * @details
+ * The GPIO register block is memory mapped and the values are read from the
+ * level registers and written to the set and clear registers, without any
+ * system call. Writing a GpioBank costs at most one store to the set and one
+ * to the clear register of each register bank.
+ *
+ * The kernel is not aware of the lines used by this driver, so the lines are
+ * reserved only against other lines of the same driver instance. Edge events
+ * are not supported.
+ *
+ * The register block can be given as an already mapped memory area, so the
+ * register logic can be used against any mapping (for example anonymous or
+ * file-backed) for testing.
+ */
+class MmapGpioDriver : public GpioDriver {
+
+public:
+
+  /// The default device providing the GPIO register block
+  static constexpr const char* default_device = "/dev/gpiomem";
+
+  /// The size of the mapped register block, in bytes
+  static constexpr std::size_t block_size = 4096;
+
+  /**
+   * @brief Creates a driver mapping the register block from the given file
+   *
+   * @param device
+   *    The file to map. It can be any file of at least block_size bytes.
+   *
+   * @throws GpioException
+   *    If the file cannot be opened or mapped
+   */
+  MmapGpioDriver(const std::string& device = default_device);
+
+  /**
+   * @brief Creates a driver using an already mapped register block
+   *
+   * @param registers
+   *    The start of the register block. The caller is responsible for keeping
+   *    the memory valid for the lifetime of the driver and the requested lines.
+   */
+  MmapGpioDriver(volatile std::uint32_t* registers);
+
+  MmapGpioDriver(const MmapGpioDriver&) = delete;
+  MmapGpioDriver& operator=(const MmapGpioDriver&) = delete;
+
+  virtual ~MmapGpioDriver() = default;
+
+  std::unique_ptr<GpioLines> requestLines(const std::vector<int>& gpios,
+                                          GpioDirection direction) override;
+
+private:
+
+  class State;
+  class Lines;
+
+  // The state is shared with the requested lines, so the mapping outlives the
+  // driver for as long as there are lines using it
+  std::shared_ptr<State> m_state;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_MMAPGPIODRIVER_H
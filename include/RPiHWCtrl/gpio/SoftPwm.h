@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file SoftPwm.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_SOFTPWM_H
+#define RPIHWCTRL_GPIO_SOFTPWM_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <RPiHWCtrl/Interfaces/Output.h>
+#include <RPiHWCtrl/gpio/GpioBank.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class SoftPwm
+ *
+ * @brief Software PWM generator for many GPIO outputs
+ *
+ * @details
+ * All the channels are driven by a single thread, which keeps a merged
+ * schedule of the edges of all the channels and sleeps on a timerfd until the
+ * next one. The edges of different channels which fall within the merge window
+ * are written with a single GpioBank write, so channels with the same
+ * frequency switch at the same time.
+ *
+ * Changes of the duty cycle or the frequency of a channel take effect at the
+ * start of its next period, so no period is ever cut short. A channel with
+ * frequency zero is disabled and kept OFF.
+ *
+ * The accuracy of the generated signal depends on how fast the thread wakes up,
+ * which can be improved by running it with real-time priority. The stats()
+ * method returns how late the edges were written.
+ */
+class SoftPwm {
+
+public:
+
+  /// Statistics of the timing of the PWM thread
+  struct Stats {
+    /// The number of the times the thread woke up for writing edges
+    std::uint64_t wakeups;
+    /// The number of the bank writes
+    std::uint64_t writes;
+    /// The number of the periods restarted because the thread was late by
+    /// more than a full period
+    std::uint64_t missed_periods;
+    /// The latency of the last wakeup, in nanoseconds
+    std::int64_t last_latency_ns;
+    /// The average latency of the wakeups, in nanoseconds
+    std::int64_t mean_latency_ns;
+    /// The maximum latency of the wakeups, in nanoseconds
+    std::int64_t max_latency_ns;
+  };
+
+  /// Output<double> for controlling the duty cycle of a single channel
+  class Channel : public Output<double> {
+  public:
+    Channel(SoftPwm& pwm, std::size_t index) : m_pwm(pwm), m_index(index) {
+    }
+    /// Sets the duty cycle of the channel (0 to 1)
+    void writeValue(const double& duty) override {
+      m_pwm.setDuty(m_index, duty);
+    }
+  private:
+    SoftPwm& m_pwm;
+    std::size_t m_index;
+  };
+
+  /**
+   * @brief Creates a PWM generator for the given GPIOs
+   *
+   * @details
+   * All the channels start disabled, with frequency zero and duty cycle zero.
+   * The channel i controls the i-th GPIO of the given list.
+   *
+   * @param gpios
+   *    The numbers of the GPIOs to use as PWM channels
+   * @param driver
+   *    The driver to use for accessing the GPIOs. If nullptr the default sysfs
+   *    driver is used.
+   * @param realtime_priority
+   *    If positive, the PWM thread is run with the SCHED_FIFO policy and this
+   *    priority (which needs the relevant privileges)
+   * @param merge_window
+   *    Edges closer than this are written together
+   *
+   * @throws GpioException
+   *    If the GPIOs cannot be reserved or the timer cannot be created
+   */
+  SoftPwm(const std::vector<int>& gpios, std::shared_ptr<GpioDriver> driver=nullptr,
+          int realtime_priority=0,
+          std::chrono::nanoseconds merge_window=std::chrono::microseconds(5));
+
+  SoftPwm(const SoftPwm&) = delete;
+  SoftPwm& operator=(const SoftPwm&) = delete;
+
+  /// Stops the PWM thread and turns OFF all the channels
+  virtual ~SoftPwm();
+
+  /// Returns the number of the channels
+  std::size_t size() const {
+    return m_bank.size();
+  }
+
+  /// Sets the duty cycle (0 to 1) of the given channel, from its next period
+  void setDuty(std::size_t channel, double duty);
+
+  /// Sets the frequency (in Hz) of the given channel, from its next period.
+  /// Zero disables the channel.
+  void setFrequency(std::size_t channel, double frequency);
+
+  /// Returns the Output<double> controlling the duty cycle of the given channel
+  Channel& channel(std::size_t channel) {
+    return m_channels.at(channel);
+  }
+
+  /// Returns true if the PWM thread runs with real-time priority
+  bool isRealtime() const {
+    return m_realtime;
+  }
+
+  /// Returns the timing statistics
+  Stats stats() const;
+
+private:
+
+  // The state of a channel, modified only by the PWM thread
+  struct ChannelState {
+    bool active = false;
+    bool value = false;
+    bool off_edge_next = false;
+    std::int64_t period_ns = 0;
+    std::int64_t on_ns = 0;
+    std::int64_t period_start = 0;
+    std::int64_t next_edge = 0;
+  };
+
+  void run();
+  void wake();
+  void processEdge(std::size_t channel, std::int64_t now,
+                   std::uint64_t& mask, std::uint64_t& values);
+
+  GpioBank m_bank;
+  std::vector<Channel> m_channels {};
+  std::vector<ChannelState> m_states;
+  std::unique_ptr<std::atomic<double>[]> m_duties;
+  std::unique_ptr<std::atomic<double>[]> m_frequencies;
+  std::int64_t m_merge_window_ns;
+  int m_timer_fd = -1;
+  int m_wakeup_fd = -1;
+  bool m_realtime = false;
+  std::atomic<bool> m_stop {false};
+
+  std::atomic<std::uint64_t> m_wakeups {0};
+  std::atomic<std::uint64_t> m_writes {0};
+  std::atomic<std::uint64_t> m_missed_periods {0};
+  std::atomic<std::int64_t> m_last_latency {0};
+  std::atomic<std::int64_t> m_total_latency {0};
+  std::atomic<std::int64_t> m_max_latency {0};
+
+  std::thread m_thread {};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_SOFTPWM_H
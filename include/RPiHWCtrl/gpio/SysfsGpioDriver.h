@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file SysfsGpioDriver.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_SYSFSGPIODRIVER_H
+#define RPIHWCTRL_GPIO_SYSFSGPIODRIVER_H
+
+#include <string>
+#include <RPiHWCtrl/gpio/GpioDriver.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class SysfsGpioDriver
+ *
+ * @brief GpioDriver using the (deprecated) sysfs interface of the kernel
+ *
+ * @details
+ * Each GPIO is exported via the export file of the sysfs GPIO class and its
+ * value file is kept open for as long as the line is reserved, so reading and
+ * writing a value costs a single pread() or pwrite() call. The sysfs interface
+ * does not support multi-line operations, so the lines are accessed one by one.
+ *
+ * When multiple lines are requested together they are all exported first and
+ * then the driver waits for all of them to become ready, so the setup time does
+ * not grow with the number of the lines. The driver waits only until the files
+ * of the exported GPIO are accessible, with a bounded fast retry.
+ */
+class SysfsGpioDriver : public GpioDriver {
+
+public:
+
+  /// The default directory of the sysfs GPIO class
+  static constexpr const char* default_sysfs_root = "/sys/class/gpio";
+
+  /// Returns the driver using the default sysfs directory
+  static std::shared_ptr<SysfsGpioDriver> getDefault();
+
+  /**
+   * @brief Creates a driver using the given sysfs directory
+   *
+   * @param sysfs_root
+   *    The directory of the sysfs GPIO class. It can be set to a different
+   *    directory for testing or benchmarking against a fake tree.
+   * @param adopt_exported
+   *    If true, GPIOs which are already exported are used as they are, instead
+   *    of throwing GpioAlreadyReserved. Such GPIOs are not unexported when
+   *    they are released.
+   */
+  SysfsGpioDriver(const std::string& sysfs_root = default_sysfs_root,
+                  bool adopt_exported = false);
+
+  virtual ~SysfsGpioDriver() = default;
+
+  std::unique_ptr<GpioLines> requestLines(const std::vector<int>& gpios,
+                                          GpioDirection direction) override;
+
+private:
+
+  std::string m_sysfs_root;
+  bool m_adopt_exported;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_SYSFSGPIODRIVER_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file Waveform.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_WAVEFORM_H
+#define RPIHWCTRL_GPIO_WAVEFORM_H
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class Waveform
+ *
+ * @brief Precomputed list of writes to a GpioBank
+ *
+ * @details
+ * Each step of the waveform sets the GPIOs selected by a mask at a time
+ * offset from the start of the waveform. The steps are kept sorted by their
+ * offset, and steps with the same offset are merged into a single write, so
+ * the WaveformSequencer can play them without any processing.
+ */
+class Waveform {
+
+public:
+
+  /// A single write of the waveform
+  struct Step {
+    /// The time of the write, from the start of the waveform
+    std::chrono::nanoseconds offset;
+    /// The bits of the bank to write
+    std::uint64_t mask;
+    /// The values of the bits selected by the mask
+    std::uint64_t values;
+  };
+
+  /**
+   * @brief Adds a step to the waveform
+   *
+   * @details
+   * If there is already a step with the same offset the two are merged. For
+   * the bits set in both masks, the values of the newer step are used.
+   */
+  Waveform& addStep(std::chrono::nanoseconds offset, std::uint64_t mask, std::uint64_t values) {
+    auto it = std::lower_bound(m_steps.begin(), m_steps.end(), offset,
+            [](const Step& step, std::chrono::nanoseconds t) { return step.offset < t; });
+    if (it != m_steps.end() && it->offset == offset) {
+      it->values = (it->values & ~mask) | (values & mask);
+      it->mask |= mask;
+    } else {
+      m_steps.insert(it, Step {offset, mask, values & mask});
+    }
+    return *this;
+  }
+
+  /// Sets the duration of the waveform, which is the time between the starts
+  /// of two repetitions when it is looped
+  Waveform& setPeriod(std::chrono::nanoseconds period) {
+    m_period = period;
+    return *this;
+  }
+
+  /// Returns the duration of the waveform. If no period was set, this is the
+  /// offset of the last step.
+  std::chrono::nanoseconds period() const {
+    return m_steps.empty() ? m_period : std::max(m_period, m_steps.back().offset);
+  }
+
+  /// Returns the steps, sorted by their offset
+  const std::vector<Step>& steps() const {
+    return m_steps;
+  }
+
+private:
+
+  std::vector<Step> m_steps {};
+  std::chrono::nanoseconds m_period {0};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_WAVEFORM_H
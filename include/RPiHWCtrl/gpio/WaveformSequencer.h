@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file WaveformSequencer.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_GPIO_WAVEFORMSEQUENCER_H
+#define RPIHWCTRL_GPIO_WAVEFORMSEQUENCER_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <RPiHWCtrl/gpio/GpioBank.h>
+#include <RPiHWCtrl/gpio/Waveform.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class WaveformSequencer
+ *
+ * @brief Plays a Waveform on a GpioBank with accurate timing
+ *
+ * @details
+ * The time of each step is computed from the time the playback started (and
+ * not from the time of the previous step), and the sequencer sleeps until it
+ * with clock_nanosleep() on an absolute time. The time spent for writing the
+ * steps is therefore not accumulated, so the output does not drift, even when
+ * the waveform is looped for a long time.
+ *
+ * A step which is written later than the late threshold is counted as late.
+ * Late steps are still written, and they do not delay the following steps.
+ */
+class WaveformSequencer {
+
+public:
+
+  /// Statistics of the timing of the played steps
+  struct Stats {
+    /// The number of the written steps
+    std::uint64_t steps;
+    /// The number of the steps written later than the late threshold
+    std::uint64_t late_steps;
+    /// The number of the completed repetitions of the waveform
+    std::uint64_t repetitions;
+    /// The average delay of the steps, in nanoseconds
+    std::int64_t mean_lateness_ns;
+    /// The maximum delay of the steps, in nanoseconds
+    std::int64_t max_lateness_ns;
+  };
+
+  /**
+   * @brief Creates a sequencer writing to the given bank
+   *
+   * @param bank
+   *    The bank to write the steps to. It must outlive the sequencer.
+   * @param late_threshold
+   *    Steps written later than this are counted as late
+   */
+  WaveformSequencer(GpioBank& bank,
+                    std::chrono::nanoseconds late_threshold=std::chrono::microseconds(100));
+
+  WaveformSequencer(const WaveformSequencer&) = delete;
+  WaveformSequencer& operator=(const WaveformSequencer&) = delete;
+
+  /// Stops any waveform played in the background
+  virtual ~WaveformSequencer();
+
+  /**
+   * @brief Plays the waveform from the calling thread
+   *
+   * @details
+   * The method returns when the waveform is completed, or when stop() is called
+   * from another thread.
+   *
+   * @param waveform
+   *    The waveform to play
+   * @param loop
+   *    If true the waveform is repeated until stop() is called
+   *
+   * @throws GpioException
+   *    If a waveform is already playing, or if a looped waveform has zero
+   *    period
+   */
+  void play(const Waveform& waveform, bool loop=false);
+
+  /// Same as play(), but the waveform is played from a background thread and
+  /// the method returns immediately
+  void start(Waveform waveform, bool loop=false);
+
+  /// Stops the playing waveform and waits for it to finish. The GPIOs keep
+  /// the values of the last written step.
+  void stop();
+
+  /// Waits until a waveform started with start() is completed
+  void wait();
+
+  /// Returns true if a waveform is currently playing
+  bool isPlaying() const {
+    return m_playing;
+  }
+
+  /// Returns the timing statistics
+  Stats stats() const;
+
+private:
+
+  void run(const Waveform& waveform, bool loop);
+  bool sleepUntil(std::int64_t deadline_ns);
+
+  GpioBank& m_bank;
+  std::int64_t m_late_threshold_ns;
+  std::atomic<bool> m_playing {false};
+  std::atomic<bool> m_stop {false};
+  std::thread m_thread {};
+
+  std::atomic<std::uint64_t> m_steps {0};
+  std::atomic<std::uint64_t> m_late_steps {0};
+  std::atomic<std::uint64_t> m_repetitions {0};
+  std::atomic<std::int64_t> m_total_lateness {0};
+  std::atomic<std::int64_t> m_max_lateness {0};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_GPIO_WAVEFORMSEQUENCER_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* 
+ * @file i2c/Endianness.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_ENDIANNESS_H
+#define RPIHWCTRL_I2C_ENDIANNESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace RPiHWCtrl {
+
+/// The byte order of the multi-byte registers of a device
+enum class Endianness {BIG, LITTLE};
+
+/// The byte order of the host
+constexpr Endianness host_endianness =
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        Endianness::BIG;
+#else
+        Endianness::LITTLE;
+#endif
+
+/**
+ * @class ByteSwap
+ * 
+ * @brief Reverses the bytes of values with the given size
+ * 
+ * @details
+ * The specializations use the compiler builtins, which compile to a single
+ * instruction on the architectures which have one.
+ */
+template <std::size_t Size>
+struct ByteSwap;
+
+template <>
+struct ByteSwap<1> {
+  using Word = std::uint8_t;
+  static Word apply(Word value) {
+    return value;
+  }
+};
+
+template <>
+struct ByteSwap<2> {
+  using Word = std::uint16_t;
+  static Word apply(Word value) {
+    return __builtin_bswap16(value);
+  }
+};
+
+template <>
+struct ByteSwap<4> {
+  using Word = std::uint32_t;
+  static Word apply(Word value) {
+    return __builtin_bswap32(value);
+  }
+};
+
+template <>
+struct ByteSwap<8> {
+  using Word = std::uint64_t;
+  static Word apply(Word value) {
+    return __builtin_bswap64(value);
+  }
+};
+
+/// Converts the bytes of a register, in the byte order E, to a value
+template <Endianness E, typename T>
+T fromDeviceBytes(const std::uint8_t* bytes) {
+  static_assert(std::is_arithmetic<T>::value, "The register type must be arithmetic");
+  typename ByteSwap<sizeof(T)>::Word word;
+  std::memcpy(&word, bytes, sizeof(T));
+  if (E != host_endianness) {
+    word = ByteSwap<sizeof(T)>::apply(word);
+  }
+  T value;
+  std::memcpy(&value, &word, sizeof(T));
+  return value;
+}
+
+/// Converts a value to the bytes of a register, in the byte order E
+template <Endianness E, typename T>
+void toDeviceBytes(T value, std::uint8_t* bytes) {
+  static_assert(std::is_arithmetic<T>::value, "The register type must be arithmetic");
+  typename ByteSwap<sizeof(T)>::Word word;
+  std::memcpy(&word, &value, sizeof(T));
+  if (E != host_endianness) {
+    word = ByteSwap<sizeof(T)>::apply(word);
+  }
+  std::memcpy(bytes, &word, sizeof(T));
+}
+
+/**
+ * @brief Converts in place count values read from a device with the byte order E
+ * 
+ * @details
+ * The loop has no dependencies between its iterations, so the compiler can
+ * vectorize it. If the byte order of the device is the same with the one of
+ * the host there is nothing to do.
+ */
+template <Endianness E, typename T>
+void fromDeviceInPlace(T* values, std::size_t count) {
+  static_assert(std::is_arithmetic<T>::value, "The register type must be arithmetic");
+  if (E == host_endianness || sizeof(T) == 1) {
+    return;
+  }
+  std::uint8_t* bytes = reinterpret_cast<std::uint8_t*>(values);
+  for (std::size_t i = 0; i < count; ++i) {
+    typename ByteSwap<sizeof(T)>::Word word;
+    std::memcpy(&word, bytes + i * sizeof(T), sizeof(T));
+    word = ByteSwap<sizeof(T)>::apply(word);
+    std::memcpy(bytes + i * sizeof(T), &word, sizeof(T));
+  }
+}
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_ENDIANNESS_H */
@@ -24,107 +24,264 @@
 #define RPIHWCTRL_I2C_I2CBUS_H
 
 #include <memory>
+#include <cstddef>
 #include <cstdint>
+#include <atomic>
 #include <mutex>
+#include <thread>
+#include <string>
 #include <array>
-#include <unistd.h> // for read() and write()
+#include <bitset>
+#include <RPiHWCtrl/i2c/Endianness.h>
+#include <RPiHWCtrl/i2c/I2CRetryPolicy.h>
 #include <RPiHWCtrl/i2c/I2CTransaction.h>
 #include <RPiHWCtrl/Interfaces/exceptions.h>
 
 namespace RPiHWCtrl {
 
+/**
+ * @class I2CBus
+ * 
+ * @brief Access to the devices connected to an I2C adapter
+ * 
+ * @details
+ * Each bus object has its own file descriptor and lock, so different adapters
+ * can be used in parallel from different threads. The getBus() method returns
+ * the shared object of an adapter and getSingleton() the one of the default
+ * adapter (/dev/i2c-1).
+ * 
+ * The registers of a device should be accessed via the methods of the
+ * I2CTransaction returned by startTransaction(). The register methods of the
+ * bus are kept for compatibility, and they can only be called from the thread
+ * which owns the current transaction.
+ */
 class I2CBus {
   
 public:
   
+  /// The adapter of the I2C bus of the GPIO header
+  static constexpr int default_adapter = 1;
+  
+  /// Returns the bus of the default adapter
   static std::shared_ptr<I2CBus> getSingleton();
   
+  /**
+   * @brief Returns the bus of the given adapter
+   * 
+   * @details
+   * All the callers asking for the same adapter get the same object, for as
+   * long as it is in use.
+   * 
+   * @throws I2CBusOpenFailure
+   *    If the device of the adapter (/dev/i2c-N) cannot be opened
+   */
+  static std::shared_ptr<I2CBus> getBus(int adapter);
+  
+  /**
+   * @brief Creates a bus using the given device file
+   * 
+   * @details
+   * This can be used for adapters with a non-standard device file, or for
+   * testing against a fake device. Note that two objects for the same device
+   * do not share their lock.
+   * 
+   * @throws I2CBusOpenFailure
+   *    If the device cannot be opened
+   */
+  explicit I2CBus(const std::string& device_path);
+  
+  I2CBus(const I2CBus&) = delete;
+  I2CBus& operator=(const I2CBus&) = delete;
+  
   virtual ~I2CBus();
   
-  I2CTransaction startTransaction(std::uint8_t address);
+  /// Returns the path of the device file of the bus
+  const std::string& devicePath() const {
+    return m_device_path;
+  }
+  
+  /**
+   * @brief Starts a transaction with the device at the given address
+   * 
+   * @details
+   * When the adapter supports combined transfers every message carries the
+   * address of the device, so the device file does not need to point to it.
+   * The messages bypass the check of the kernel for devices which are used by
+   * a driver, so the first transaction with each address checks it with the
+   * I2C_SLAVE ioctl, and the following ones do not need any system call. A
+   * driver bound to the device after the check is not detected. Without
+   * combined transfers the device file is pointed to the address with the
+   * I2C_SLAVE ioctl, only if it does not already point to it.
+   * 
+   * @param address
+   *    The address of the device
+   * @param force
+   *    If true the device can be accessed even if a kernel driver is bound to
+   *    it. The address is then not checked, or the I2C_SLAVE_FORCE ioctl is
+   *    used without combined transfers.
+   * 
+   * @throws I2CDeviceConnectionFailure
+   *    If the address is invalid, or (when force is false) the device is used
+   *    by a kernel driver
+   */
+  I2CTransaction startTransaction(std::uint8_t address, bool force=false);
+  
+  /**
+   * @brief Sets how the operations of the following transactions are retried
+   * 
+   * @details
+   * It waits for the current transaction to end, so it must not be called
+   * from a thread which owns a transaction of the bus.
+   */
+  void setRetryPolicy(const I2CRetryPolicy& retry_policy);
+  
+  /// Returns how the operations of the transactions are retried
+  I2CRetryPolicy retryPolicy() const;
+  
+  /// Returns true if the adapter supports combined transfers, in which case
+  /// registers are read with a single repeated-start transaction
+  bool supportsCombinedTransfers() const {
+    return m_combined_transfers;
+  }
   
   
   template <std::size_t Size>
   std::array<std::uint8_t, Size> readRegisterAsArray(std::uint8_t register_address) {
     
-    // First check that the mutex is locked. If it is not means that we are not in
-    // a valid transaction.
-    if (m_bus_mutex.try_lock()) {
-      m_bus_mutex.unlock();
-      throw I2CActionOutOfTransaction();
-    }
-    
-    // Write to the bus the register we want to read
-    if (write(m_bus_file, &register_address, 1) != 1) {
-      throw I2CReadRegisterException(register_address);
-    }
+    checkTransaction();
     
     // Read the register in the array
     std::array<std::uint8_t, Size> buffer;
-    if (read(m_bus_file, buffer.begin(), Size) != Size) {
-      throw I2CReadRegisterException(register_address);
+    auto status = I2CTransaction::readRegisterBytes(m_bus_file, m_address, m_combined_transfers,
+                                                    m_retry_policy, register_address,
+                                                    buffer.data(), Size);
+    if (!status) {
+      throw I2CReadRegisterException(register_address, status.err_code);
     }
     
     return buffer;
   }
   
   
+  /**
+   * @brief Reads a multi-byte register
+   * 
+   * @tparam T
+   *    The type of the register value
+   * @tparam E
+   *    The byte order of the register in the device
+   */
+  template <typename T, Endianness E=Endianness::BIG>
+  T readRegister(std::uint8_t register_address) {
+    auto buffer = readRegisterAsArray<sizeof(T)>(register_address);
+    return fromDeviceBytes<E, T>(buffer.data());
+  }
+  
+  /// Same as readRegister<T, E>(), with the byte order given at runtime. If
+  /// invert is false the register is big endian.
   template <typename T>
-  T readRegister(std::uint8_t register_address, bool invert=false) {
+  T readRegister(std::uint8_t register_address, bool invert) {
+    return invert ? readRegister<T, Endianness::LITTLE>(register_address)
+                  : readRegister<T, Endianness::BIG>(register_address);
+  }
+  
+  /**
+   * @brief Reads count samples from consecutive registers
+   * 
+   * @details
+   * All the samples are read with a single burst read directly in the buffer,
+   * and they are converted to the byte order of the host in place. This is
+   * useful for reading the FIFO of a device.
+   * 
+   * @tparam T
+   *    The type of the samples
+   * @tparam E
+   *    The byte order of the samples in the device
+   */
+  template <typename T, Endianness E=Endianness::BIG>
+  void readSamples(std::uint8_t register_address, T* buffer, std::size_t count) {
     
-    //Read the register as an array
-    auto buffer = readRegisterAsArray<sizeof(T)>(register_address);
+    checkTransaction();
     
-    // Convert the 8-bit unsigned integers to the type to return
-    T result {};
-    std::uint8_t* result_ptr = reinterpret_cast<std::uint8_t*>(&result);
-    for (int i = 0; i < buffer.size(); ++i) {
-      if (invert) {
-        result_ptr[i] = buffer[i];
-      } else {
-        result_ptr[i] = buffer[buffer.size() - i - 1];
-      }
+    auto status = I2CTransaction::readRegisterBytes(m_bus_file, m_address, m_combined_transfers,
+                                                    m_retry_policy, register_address,
+                                                    reinterpret_cast<std::uint8_t*>(buffer),
+                                                    count * sizeof(T));
+    if (!status) {
+      throw I2CReadRegisterException(register_address, status.err_code);
     }
-    
-    return result;
+    fromDeviceInPlace<E>(buffer, count);
   }
   
-  
-  template <typename T>
-  void writeRegister(std::uint8_t register_address, T value, bool invert=false) {
+  /**
+   * @brief Writes a multi-byte register
+   * 
+   * @tparam T
+   *    The type of the register value
+   * @tparam E
+   *    The byte order of the register in the device
+   */
+  template <typename T, Endianness E=Endianness::BIG>
+  void writeRegister(std::uint8_t register_address, T value) {
     
-    // First check that the mutex is locked. If it is not means that we are not in
-    // a valid transaction.
-    if (m_bus_mutex.try_lock()) {
-      m_bus_mutex.unlock();
-      throw I2CActionOutOfTransaction();
-    }
+    checkTransaction();
     
     // Construct the array to send to the bus
     std::array<std::uint8_t, sizeof(T) + 1> buffer;
     buffer[0] = register_address;
-    std::uint8_t* value_ptr = reinterpret_cast<std::uint8_t*>(&value);
-    for (int i = 0; i < sizeof(T); ++i) {
-      if (invert) {
-        buffer[i+1] = *(value_ptr + i);
-      } else {
-        buffer[i+1] = *(value_ptr + sizeof(T)-i-1);
-      }
-    }
+    toDeviceBytes<E>(value, buffer.data() + 1);
     
     // Write the message to the bus
-    if (write(m_bus_file, buffer.begin(), sizeof(buffer)) != sizeof(buffer)) {
-      throw I2CWriteRegisterException<T>(register_address, value);
+    auto status = I2CTransaction::writeMessage(m_bus_file, m_address, m_combined_transfers,
+                                               m_retry_policy, buffer.data(), buffer.size());
+    if (!status) {
+      throw I2CWriteRegisterException<T>(register_address, value, status.err_code);
     }
     
   }
   
+  /// Same as writeRegister<T, E>(), with the byte order given at runtime. If
+  /// invert is false the register is big endian.
+  template <typename T>
+  void writeRegister(std::uint8_t register_address, T value, bool invert) {
+    if (invert) {
+      writeRegister<T, Endianness::LITTLE>(register_address, value);
+    } else {
+      writeRegister<T, Endianness::BIG>(register_address, value);
+    }
+  }
+  
 private:
   
-  I2CBus();
+  // Throws if the calling thread does not own a transaction. This costs a
+  // single atomic load, and unlike checking the mutex it also fails when
+  // another thread holds the bus.
+  void checkTransaction() const {
+    if (m_owner.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+      throw I2CActionOutOfTransaction();
+    }
+  }
+  
+  // Points the read() and write() calls of the bus file to the given address
+  void selectAddress(std::uint8_t address, bool force);
+  
+  // Checks that the device is not used by a kernel driver, if the address was
+  // not already checked
+  void checkAddress(std::uint8_t address);
   
+  std::string m_device_path;
   int m_bus_file;
-  std::mutex m_bus_mutex;
+  mutable std::mutex m_bus_mutex;
+  std::atomic<std::thread::id> m_owner {};
+  std::uint8_t m_address = 0;
+  bool m_combined_transfers = false;
+  // The address set with the last I2C_SLAVE ioctl, or -1 if none
+  int m_selected_address = -1;
+  bool m_selected_force = false;
+  // The addresses checked by the checkAddress()
+  std::bitset<128> m_checked_addresses {};
+  // Accessed only while holding the m_bus_mutex
+  I2CRetryPolicy m_retry_policy {};
 
 };
 
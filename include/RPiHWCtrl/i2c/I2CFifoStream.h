@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file i2c/I2CFifoStream.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_I2CFIFOSTREAM_H
+#define RPIHWCTRL_I2C_I2CFIFOSTREAM_H
+
+#include <time.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <RPiHWCtrl/i2c/I2CBus.h>
+#include <RPiHWCtrl/utils/SpscRing.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class I2CFifoStream
+ *
+ * @brief Continuous reader of the FIFO of an I2C sensor
+ *
+ * @details
+ * A dedicated thread wakes up at a fixed interval (on an absolute schedule, so
+ * it does not drift), reads all the samples available in the FIFO of the
+ * device with a single burst read and pushes them, with their timestamps, in
+ * a preallocated ring. The consumer accesses the samples in place, via the
+ * readSpan() and consume() methods, so they are never copied after they are
+ * decoded.
+ *
+ * The thread is the producer and there must be a single consumer thread.
+ *
+ * @tparam T
+ *    The type of the values of the samples
+ * @tparam Channels
+ *    The number of the values of each sample (for example 3 for a three axis
+ *    accelerometer)
+ * @tparam E
+ *    The byte order of the values in the device
+ */
+template <typename T, std::size_t Channels=1, Endianness E=Endianness::BIG>
+class I2CFifoStream {
+
+public:
+
+  /// A single sample of the device
+  struct Sample {
+    /// The estimated time of the sample, in nanoseconds of CLOCK_MONOTONIC
+    std::uint64_t timestamp_ns;
+    /// The values of the sample, converted to the byte order of the host
+    std::array<T, Channels> values;
+  };
+
+  /// The configuration of the stream
+  struct Config {
+    /// The address of the device
+    std::uint8_t address;
+    /// The register which returns the FIFO data with a burst read
+    std::uint8_t data_register;
+    /// The time between two bursts
+    std::chrono::nanoseconds poll_interval;
+    /// The time between two samples of the device, used for estimating the
+    /// timestamps of the samples of a burst. If zero, all the samples of a
+    /// burst get the time of the burst.
+    std::chrono::nanoseconds sample_period;
+    /// The maximum number of the samples read with a single burst
+    std::size_t max_burst;
+    /// Returns how many samples the FIFO contains. It is called from the
+    /// stream thread within the transaction of the burst. If not set, every
+    /// burst reads max_burst samples.
+    std::function<std::size_t(I2CTransaction&)> available;
+  };
+
+  /// Statistics of the stream
+  struct Stats {
+    /// The number of the samples pushed in the ring
+    std::uint64_t samples;
+    /// The number of the samples lost because the ring was full
+    std::uint64_t overruns;
+    /// The number of the bursts which found the FIFO empty
+    std::uint64_t underruns;
+    /// The number of the bursts which failed, for any reason
+    std::uint64_t errors;
+    /// The number of the samples per second since the stream started
+    double effective_rate;
+  };
+
+  /**
+   * @brief Creates a stream and starts its thread
+   *
+   * @param bus
+   *    The bus of the device
+   * @param config
+   *    The configuration of the stream
+   * @param ring_capacity
+   *    The number of the samples the ring can keep (rounded up to a power of
+   *    two)
+   * 
+   * @throws I2CException
+   *    If the poll interval is not positive
+   */
+  I2CFifoStream(std::shared_ptr<I2CBus> bus, Config config, std::size_t ring_capacity)
+          : m_bus(std::move(bus)), m_config(std::move(config)),
+            m_buffer(std::max<std::size_t>(m_config.max_burst, 1) * Channels),
+            m_ring(ring_capacity) {
+    // A zero interval would make the stream thread spin without sleeping
+    if (m_config.poll_interval <= std::chrono::nanoseconds::zero()) {
+      throw I2CException() << "The poll interval of an I2CFifoStream must be positive";
+    }
+    m_config.max_burst = std::max<std::size_t>(m_config.max_burst, 1);
+    m_start_ns = monotonicNs();
+    m_thread = std::thread {&I2CFifoStream::run, this};
+  }
+
+  I2CFifoStream(const I2CFifoStream&) = delete;
+  I2CFifoStream& operator=(const I2CFifoStream&) = delete;
+
+  /// Stops the stream thread
+  virtual ~I2CFifoStream() {
+    m_stop = true;
+    m_thread.join();
+  }
+
+  /// Sets data to the oldest samples and returns how many of them are
+  /// contiguous (see SpscRing::readSpan())
+  std::size_t readSpan(const Sample*& data) const {
+    return m_ring.readSpan(data);
+  }
+
+  /// Releases the given number of samples returned by readSpan()
+  void consume(std::size_t count) {
+    m_ring.consume(count);
+  }
+
+  /// Returns the number of the samples waiting in the ring
+  std::size_t size() const {
+    return m_ring.size();
+  }
+
+  /// Returns the statistics of the stream
+  Stats stats() const {
+    Stats result;
+    result.samples = m_samples.load(std::memory_order_relaxed);
+    result.overruns = m_overruns.load(std::memory_order_relaxed);
+    result.underruns = m_underruns.load(std::memory_order_relaxed);
+    result.errors = m_errors.load(std::memory_order_relaxed);
+    double elapsed = (monotonicNs() - m_start_ns) / 1e9;
+    result.effective_rate = elapsed > 0 ? result.samples / elapsed : 0.;
+    return result;
+  }
+
+private:
+
+  static std::int64_t monotonicNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return std::int64_t{now.tv_sec} * 1000000000 + now.tv_nsec;
+  }
+
+  void run() {
+    std::int64_t next = monotonicNs();
+    while (!m_stop) {
+      next += m_config.poll_interval.count();
+      timespec ts;
+      ts.tv_sec = next / 1000000000;
+      ts.tv_nsec = next % 1000000000;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+      }
+      // Any exception (for example from the available function) is counted
+      // as a failed burst, because it must not escape the thread
+      try {
+        readBurst();
+      } catch (...) {
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void readBurst() {
+    std::size_t count = m_config.max_burst;
+    std::int64_t now;
+    {
+      auto transaction = m_bus->startTransaction(m_config.address);
+      if (m_config.available) {
+        count = std::min(count, m_config.available(transaction));
+      }
+      if (count == 0) {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      transaction.template readSamples<T, E>(m_config.data_register, m_buffer.data(), count * Channels);
+      now = monotonicNs();
+    }
+
+    // The last sample of the burst is the newest one, and the ones before it
+    // were taken one sample period earlier each
+    std::size_t written = 0;
+    while (written < count) {
+      Sample* slots;
+      std::size_t free = m_ring.writeSpan(slots);
+      if (free == 0) {
+        break;
+      }
+      std::size_t n = std::min(free, count - written);
+      for (std::size_t i = 0; i < n; ++i) {
+        std::size_t index = written + i;
+        slots[i].timestamp_ns = now - std::int64_t(count - 1 - index) * m_config.sample_period.count();
+        std::copy_n(m_buffer.begin() + index * Channels, Channels, slots[i].values.begin());
+      }
+      m_ring.commitWrite(n);
+      written += n;
+    }
+    m_samples.fetch_add(written, std::memory_order_relaxed);
+    m_overruns.fetch_add(count - written, std::memory_order_relaxed);
+  }
+
+  std::shared_ptr<I2CBus> m_bus;
+  Config m_config;
+  std::vector<T> m_buffer;
+  SpscRing<Sample> m_ring;
+  std::int64_t m_start_ns = 0;
+  std::atomic<bool> m_stop {false};
+  std::atomic<std::uint64_t> m_samples {0};
+  std::atomic<std::uint64_t> m_overruns {0};
+  std::atomic<std::uint64_t> m_underruns {0};
+  std::atomic<std::uint64_t> m_errors {0};
+  std::thread m_thread {};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_I2CFIFOSTREAM_H */
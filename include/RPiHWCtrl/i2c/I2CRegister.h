@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* 
+ * @file i2c/I2CRegister.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_I2CREGISTER_H
+#define RPIHWCTRL_I2C_I2CREGISTER_H
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <RPiHWCtrl/i2c/Endianness.h>
+#include <RPiHWCtrl/i2c/I2CTransaction.h>
+
+namespace RPiHWCtrl {
+
+/// What a register of a device allows
+enum class RegisterAccess {READ_ONLY, WRITE_ONLY, READ_WRITE};
+
+/**
+ * @class I2CRegister
+ * 
+ * @brief Compile time description of a register of an I2C device
+ * 
+ * @details
+ * A driver describes each register of its device once, as a type:
+ * 
+ *     using OutX = I2CRegister<0x28, std::int16_t, Endianness::LITTLE, RegisterAccess::READ_ONLY>;
+ * 
+ * and accesses it with OutX::read(transaction). The address, the width and the
+ * byte order are template parameters, so the access code is generated at
+ * compile time, and accessing a register against its access mode does not
+ * compile.
+ * 
+ * @tparam Address
+ *    The address of the (first byte of the) register
+ * @tparam T
+ *    The type of the value of the register, which also defines its width
+ * @tparam E
+ *    The byte order of the register in the device
+ * @tparam A
+ *    What the register allows
+ */
+template <std::uint8_t Address, typename T, Endianness E=Endianness::BIG,
+          RegisterAccess A=RegisterAccess::READ_WRITE>
+struct I2CRegister {
+  
+  static_assert(std::is_arithmetic<T>::value, "The register type must be arithmetic");
+  static_assert(Address + sizeof(T) <= 256, "The register exceeds the register address space");
+  
+  using Type = T;
+  static constexpr std::uint8_t address = Address;
+  static constexpr std::size_t size = sizeof(T);
+  static constexpr Endianness endianness = E;
+  static constexpr RegisterAccess access = A;
+  static constexpr bool readable = A != RegisterAccess::WRITE_ONLY;
+  static constexpr bool writable = A != RegisterAccess::READ_ONLY;
+  
+  /// Converts the bytes of the register, as read from the device, to its value
+  static T decode(const std::uint8_t* bytes) {
+    return fromDeviceBytes<E, T>(bytes);
+  }
+  
+  /// Reads the register from the device
+  static T read(I2CTransaction& transaction) {
+    static_assert(readable, "The register is write only");
+    return transaction.readRegister<T, E>(Address);
+  }
+  
+  /// Reads the register from the device, without throwing
+  static I2CResult<T> tryRead(I2CTransaction& transaction) {
+    static_assert(readable, "The register is write only");
+    return transaction.tryReadRegister<T, E>(Address);
+  }
+  
+  /// Writes the register to the device
+  static void write(I2CTransaction& transaction, T value) {
+    static_assert(writable, "The register is read only");
+    transaction.writeRegister<T, E>(Address, value);
+  }
+  
+  /// Defers the write of the register (see I2CTransaction::deferWrite()), so
+  /// writes of adjacent registers are merged into one burst
+  static void deferWrite(I2CTransaction& transaction, T value) {
+    static_assert(writable, "The register is read only");
+    transaction.deferWriteRegister<T, E>(Address, value);
+  }
+  
+};
+
+template <std::uint8_t Address, typename T, Endianness E, RegisterAccess A>
+constexpr std::uint8_t I2CRegister<Address, T, E, A>::address;
+template <std::uint8_t Address, typename T, Endianness E, RegisterAccess A>
+constexpr std::size_t I2CRegister<Address, T, E, A>::size;
+template <std::uint8_t Address, typename T, Endianness E, RegisterAccess A>
+constexpr Endianness I2CRegister<Address, T, E, A>::endianness;
+template <std::uint8_t Address, typename T, Endianness E, RegisterAccess A>
+constexpr RegisterAccess I2CRegister<Address, T, E, A>::access;
+template <std::uint8_t Address, typename T, Endianness E, RegisterAccess A>
+constexpr bool I2CRegister<Address, T, E, A>::readable;
+template <std::uint8_t Address, typename T, Endianness E, RegisterAccess A>
+constexpr bool I2CRegister<Address, T, E, A>::writable;
+
+/**
+ * @class I2CBitField
+ * 
+ * @brief Compile time description of a group of bits of a register
+ * 
+ * @details
+ * The masks and the shifts are constants, so accessing a field costs the
+ * access of its register and a couple of instructions.
+ * 
+ * @tparam Register
+ *    The I2CRegister the field belongs to, which must have an unsigned type
+ * @tparam Offset
+ *    The position of the lowest bit of the field
+ * @tparam Width
+ *    The number of the bits of the field
+ */
+template <typename Register, unsigned Offset, unsigned Width>
+struct I2CBitField {
+  
+  using Type = typename Register::Type;
+  
+  static_assert(std::is_unsigned<Type>::value, "Bit fields need an unsigned register type");
+  static_assert(Width > 0 && Offset + Width <= 8 * sizeof(Type),
+                "The bit field does not fit in its register");
+  
+  /// The bits of the register which belong to the field
+  static constexpr Type mask = static_cast<Type>(
+          (Width == 8 * sizeof(Type) ? ~std::uint64_t{0} : (std::uint64_t{1} << Width) - 1)
+          << Offset);
+  
+  /// Extracts the field from the value of its register
+  static Type get(Type register_value) {
+    return static_cast<Type>((register_value & mask) >> Offset);
+  }
+  
+  /// Returns the value of the register with the field replaced
+  static Type set(Type register_value, Type value) {
+    return static_cast<Type>((register_value & ~mask) | ((value << Offset) & mask));
+  }
+  
+  /// Reads the field from the device
+  static Type read(I2CTransaction& transaction) {
+    return get(Register::read(transaction));
+  }
+  
+  /// Changes the field in the device with a read-modify-write of its register
+  static void write(I2CTransaction& transaction, Type value) {
+    static_assert(Register::access == RegisterAccess::READ_WRITE,
+                  "Writing a bit field needs a read-write register");
+    Register::write(transaction, set(Register::read(transaction), value));
+  }
+  
+};
+
+template <typename Register, unsigned Offset, unsigned Width>
+constexpr typename Register::Type I2CBitField<Register, Offset, Width>::mask;
+
+/**
+ * @class I2CRegisterGroup
+ * 
+ * @brief Registers which are read together
+ * 
+ * @details
+ * The read() method reads all the registers with a single submit() of the
+ * transaction, and returns their values as a tuple. The registers are sorted
+ * by their addresses and the ones which directly follow each other are fused
+ * into a single burst read, so for example the six registers of the three
+ * axes of a sensor cost a single I2C message pair. The sorting and the bursts
+ * are computed at compile time, so the registers can be listed in any order
+ * and they still get the minimum number of messages.
+ * 
+ * The device must auto-increment its register address for burst reads.
+ * 
+ * @tparam Registers
+ *    The I2CRegister types of the registers to read
+ */
+template <typename... Registers>
+class I2CRegisterGroup {
+  
+public:
+  
+  static_assert(sizeof...(Registers) > 0, "A register group needs at least one register");
+  
+  /// The values of the registers, in the order of the template parameters
+  using Values = std::tuple<typename Registers::Type...>;
+  
+  /// Returns the number of the burst reads the group is read with
+  static constexpr std::size_t bursts() {
+    std::size_t count = 0;
+    for (std::size_t k = 0; k < sizeof...(Registers); ++k) {
+      count += startsBurst(k) ? 1 : 0;
+    }
+    return count;
+  }
+  
+  /**
+   * @brief Reads all the registers of the group
+   * 
+   * @details
+   * Any operations already queued on the transaction are submitted together
+   * with the reads of the group.
+   * 
+   * @throws I2CTransferException
+   *    If reading from the device fails
+   */
+  static Values read(I2CTransaction& transaction) {
+    static_assert(allReadable(), "A register of the group is write only");
+    std::array<std::uint8_t, bufferSize()> buffer;
+    queueBursts(transaction, buffer.data(), std::index_sequence_for<Registers...>{});
+    transaction.submit();
+    return decode(buffer.data(), std::index_sequence_for<Registers...>{});
+  }
+  
+private:
+  
+  static constexpr bool allReadable() {
+    const bool readable[] = {Registers::readable...};
+    for (bool r : readable) {
+      if (!r) {
+        return false;
+      }
+    }
+    return true;
+  }
+  
+  static constexpr std::size_t bufferSize() {
+    const std::size_t sizes[] = {Registers::size...};
+    std::size_t result = 0;
+    for (std::size_t size : sizes) {
+      result += size;
+    }
+    return result;
+  }
+  
+  // The position of the i-th register when the registers are sorted by their
+  // addresses. Registers with the same address keep their order.
+  static constexpr std::size_t rank(std::size_t i) {
+    const std::size_t addresses[] = {Registers::address...};
+    std::size_t result = 0;
+    for (std::size_t j = 0; j < sizeof...(Registers); ++j) {
+      if (addresses[j] < addresses[i] || (addresses[j] == addresses[i] && j < i)) {
+        ++result;
+      }
+    }
+    return result;
+  }
+  
+  // The index of the register at the k-th sorted position
+  static constexpr std::size_t sorted(std::size_t k) {
+    std::size_t i = 0;
+    while (rank(i) != k) {
+      ++i;
+    }
+    return i;
+  }
+  
+  static constexpr std::size_t address(std::size_t i) {
+    const std::size_t addresses[] = {Registers::address...};
+    return addresses[i];
+  }
+  
+  static constexpr std::size_t size(std::size_t i) {
+    const std::size_t sizes[] = {Registers::size...};
+    return sizes[i];
+  }
+  
+  // The offset of the i-th register in the buffer, where the registers are
+  // kept in the order of their addresses
+  static constexpr std::size_t offset(std::size_t i) {
+    std::size_t result = 0;
+    for (std::size_t k = 0; k < rank(i); ++k) {
+      result += size(sorted(k));
+    }
+    return result;
+  }
+  
+  // A register starts a new burst unless it directly follows the previous one
+  // in the sorted order
+  static constexpr bool startsBurst(std::size_t k) {
+    return k == 0 || address(sorted(k)) != address(sorted(k - 1)) + size(sorted(k - 1));
+  }
+  
+  // The number of the bytes of the burst starting at the k-th sorted position
+  static constexpr std::size_t burstSize(std::size_t k) {
+    std::size_t result = size(sorted(k));
+    for (std::size_t j = k + 1; j < sizeof...(Registers) && !startsBurst(j); ++j) {
+      result += size(sorted(j));
+    }
+    return result;
+  }
+  
+  template <std::size_t... K>
+  static void queueBursts(I2CTransaction& transaction, std::uint8_t* buffer,
+                          std::index_sequence<K...>) {
+    // The conditions are constants, so only the reads of the bursts remain
+    int expand[] = {0, (startsBurst(K)
+                        ? (transaction.queueRead(static_cast<std::uint8_t>(address(sorted(K))),
+                                                 buffer + offset(sorted(K)), burstSize(K)), 0)
+                        : 0)...};
+    (void)expand;
+  }
+  
+  template <std::size_t... I>
+  static Values decode(const std::uint8_t* buffer, std::index_sequence<I...>) {
+    return Values {Registers::decode(buffer + offset(I))...};
+  }
+  
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_I2CREGISTER_H */
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file i2c/I2CRegisterCache.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_I2CREGISTERCACHE_H
+#define RPIHWCTRL_I2C_I2CREGISTERCACHE_H
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include <RPiHWCtrl/i2c/I2CBus.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class I2CRegisterCache
+ *
+ * @brief Cache of the registers of a single I2C device
+ *
+ * @details
+ * All the registers start as volatile, which means that they are always read
+ * from and written to the device. Registers which change only when they are
+ * written (typically the configuration registers) can be marked as cacheable,
+ * in which case they are read from the device only the first time and the
+ * following reads cost no bus traffic.
+ *
+ * Writes of cacheable registers are sent to the device immediately with the
+ * WRITE_THROUGH policy. With the WRITE_BACK policy they only update the cache
+ * and mark the registers dirty, and the sync() method sends all the dirty
+ * registers to the device, merging consecutive ones into burst writes.
+ *
+ * All the methods are thread safe.
+ */
+class I2CRegisterCache {
+
+public:
+
+  /// How the writes of cacheable registers are handled
+  enum class WritePolicy {WRITE_THROUGH, WRITE_BACK};
+
+  /**
+   * @brief Creates an empty cache for the given device
+   *
+   * @param bus
+   *    The bus the device is connected to
+   * @param address
+   *    The address of the device
+   * @param policy
+   *    How the writes of cacheable registers are handled
+   */
+  I2CRegisterCache(std::shared_ptr<I2CBus> bus, std::uint8_t address,
+                   WritePolicy policy=WritePolicy::WRITE_THROUGH);
+
+  I2CRegisterCache(const I2CRegisterCache&) = delete;
+  I2CRegisterCache& operator=(const I2CRegisterCache&) = delete;
+
+  /// Sends any dirty registers to the device. Errors are ignored, so sync()
+  /// should be called explicitly if they matter.
+  virtual ~I2CRegisterCache();
+
+  /// Marks the registers from first to last (inclusive) as cacheable or
+  /// volatile. Making a register volatile discards its cached value.
+  void setCacheable(std::uint8_t first, std::uint8_t last, bool cacheable=true);
+
+  /// Reads a single register
+  std::uint8_t read(std::uint8_t register_address);
+
+  /**
+   * @brief Reads size consecutive registers
+   *
+   * @details
+   * If all the registers are cached they are returned without any bus
+   * traffic. Otherwise they are all read with a single burst read, and the
+   * cached values of the dirty registers replace the ones read.
+   *
+   * @throws I2CException
+   *    If reading from the device fails
+   */
+  void read(std::uint8_t register_address, std::uint8_t* buffer, std::size_t size);
+
+  /// Writes a single register
+  void write(std::uint8_t register_address, std::uint8_t value);
+
+  /**
+   * @brief Writes size consecutive registers
+   *
+   * @details
+   * If the policy is WRITE_BACK and all the registers are cacheable, only the
+   * cache is updated. Otherwise the registers are written to the device with a
+   * single burst write.
+   *
+   * @throws I2CException
+   *    If writing to the device fails
+   */
+  void write(std::uint8_t register_address, const std::uint8_t* data, std::size_t size);
+
+  /// Sets the bits of the register selected by the mask to the given value,
+  /// using the cached value of the register if there is one
+  void update(std::uint8_t register_address, std::uint8_t mask, std::uint8_t value);
+
+  /**
+   * @brief Writes all the dirty registers to the device
+   *
+   * @details
+   * Runs of consecutive dirty registers are written with burst writes, and
+   * all of them are sent with a single submit.
+   *
+   * @throws I2CException
+   *    If writing to the device fails, in which case the registers stay dirty
+   */
+  void sync();
+
+  /// Discards all the cached values, including the dirty ones
+  void invalidate();
+
+  /// Returns the number of the dirty registers
+  std::size_t dirtyCount() const;
+
+  /// Returns the number of the reads served without bus traffic
+  std::uint64_t hits() const {
+    return m_hits.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the number of the reads which accessed the device
+  std::uint64_t misses() const {
+    return m_misses.load(std::memory_order_relaxed);
+  }
+
+private:
+
+  static constexpr std::size_t register_count = 256;
+
+  bool allSet(const std::bitset<register_count>& bits, std::size_t first,
+              std::size_t size) const;
+  void checkRange(std::uint8_t register_address, std::size_t size) const;
+  void readLocked(std::uint8_t register_address, std::uint8_t* buffer, std::size_t size);
+  void writeLocked(std::uint8_t register_address, const std::uint8_t* data, std::size_t size);
+  void syncLocked();
+
+  std::shared_ptr<I2CBus> m_bus;
+  std::uint8_t m_address;
+  WritePolicy m_policy;
+  mutable std::mutex m_mutex {};
+  std::array<std::uint8_t, register_count> m_values {};
+  std::bitset<register_count> m_cacheable {};
+  std::bitset<register_count> m_valid {};
+  std::bitset<register_count> m_dirty {};
+  std::atomic<std::uint64_t> m_hits {0};
+  std::atomic<std::uint64_t> m_misses {0};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_I2CREGISTERCACHE_H */
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file i2c/I2CRequestQueue.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_I2CREQUESTQUEUE_H
+#define RPIHWCTRL_I2C_I2CREQUESTQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <RPiHWCtrl/i2c/I2CBus.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class I2CRequestQueue
+ *
+ * @brief Asynchronous access to the devices of an I2CBus
+ *
+ * @details
+ * The requests are executed by a worker thread, which is the only user of the
+ * bus for the queue. A request is a function which queues operations on the
+ * I2CTransaction of its device (see I2CTransaction::queueRead()), and the
+ * worker submits them. When back-to-back requests target the same device, the
+ * worker executes them in a single transaction. Each request is still
+ * submitted on its own, so a failing request does not affect the others and
+ * the operations of a request which throws are not sent.
+ *
+ * There are three priority classes. The worker always continues with the
+ * oldest request of the highest class. It checks for waiting requests of a
+ * higher class before it adds each request to a batch, so a HIGH request
+ * waits at most for the requests already in the batch in progress and for
+ * the HIGH requests before it.
+ *
+ * Only one queue should be created for each bus.
+ */
+class I2CRequestQueue {
+
+public:
+
+  /// The priority classes of the requests
+  enum class Priority {HIGH = 0, NORMAL = 1, LOW = 2};
+
+  /// Called with nullptr when a request succeeds, or with the exception which
+  /// made it fail
+  using Callback = std::function<void(std::exception_ptr)>;
+
+  /// Statistics of a single priority class
+  struct ClassMetrics {
+    /// The number of the requests currently waiting
+    std::size_t queue_depth;
+    /// The maximum number of the requests which waited at the same time
+    std::size_t max_queue_depth;
+    /// The number of the requests which completed (successfully or not)
+    std::uint64_t completed;
+    /// The average time the requests waited before their execution started
+    std::chrono::nanoseconds mean_wait;
+    /// The maximum time a request waited before its execution started
+    std::chrono::nanoseconds max_wait;
+  };
+
+  /**
+   * @brief Creates a queue for the given bus and starts its worker thread
+   *
+   * @param bus
+   *    The bus the requests are executed on
+   * @param max_batch
+   *    The maximum number of requests executed in the same transaction
+   */
+  I2CRequestQueue(std::shared_ptr<I2CBus> bus, std::size_t max_batch=16);
+
+  I2CRequestQueue(const I2CRequestQueue&) = delete;
+  I2CRequestQueue& operator=(const I2CRequestQueue&) = delete;
+
+  /// Stops the worker thread. Requests which did not start yet fail with an
+  /// I2CException.
+  virtual ~I2CRequestQueue();
+
+  /**
+   * @brief Adds a request to the queue
+   *
+   * @param address
+   *    The address of the device
+   * @param prepare
+   *    Called from the worker thread, to queue the operations of the request
+   *    on the transaction. It can also use the register methods of the
+   *    transaction, which access the device immediately.
+   * @param callback
+   *    Called from the worker thread when the request completes
+   * @param priority
+   *    The priority class of the request
+   */
+  void submit(std::uint8_t address, std::function<void(I2CTransaction&)> prepare,
+              Callback callback, Priority priority=Priority::NORMAL);
+
+  /// Same as the submit() with a callback, but returns a future instead
+  std::future<void> submit(std::uint8_t address, std::function<void(I2CTransaction&)> prepare,
+                           Priority priority=Priority::NORMAL);
+
+  /// Reads size consecutive registers, starting from the given one
+  std::future<std::vector<std::uint8_t>> readRegisters(std::uint8_t address,
+          std::uint8_t register_address, std::size_t size,
+          Priority priority=Priority::NORMAL);
+
+  /// Writes the given data to consecutive registers, starting from the given one
+  std::future<void> writeRegisters(std::uint8_t address, std::uint8_t register_address,
+          std::vector<std::uint8_t> data, Priority priority=Priority::NORMAL);
+
+  /// Returns the statistics of the given priority class
+  ClassMetrics metrics(Priority priority) const;
+
+private:
+
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::size_t priority_classes = 3;
+
+  struct Request {
+    std::uint8_t address;
+    std::function<void(I2CTransaction&)> prepare;
+    Callback callback;
+    Clock::time_point enqueued;
+  };
+
+  struct Counters {
+    std::size_t max_depth = 0;
+    std::uint64_t started = 0;
+    std::uint64_t completed = 0;
+    std::chrono::nanoseconds total_wait {0};
+    std::chrono::nanoseconds max_wait {0};
+  };
+
+  void run();
+  // Removes the oldest request of the given class and updates the wait time
+  // statistics. Must be called with the mutex locked.
+  Request popRequest(std::size_t index);
+  // Returns true if a class higher than the given one has waiting requests.
+  // Must be called with the mutex locked.
+  bool higherPending(std::size_t index) const;
+
+  std::shared_ptr<I2CBus> m_bus;
+  std::size_t m_max_batch;
+  mutable std::mutex m_mutex {};
+  std::condition_variable m_pending {};
+  std::array<std::deque<Request>, priority_classes> m_queues {};
+  std::array<Counters, priority_classes> m_counters {};
+  bool m_stopping = false;
+  std::thread m_thread {};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_I2CREQUESTQUEUE_H */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* 
+ * @file i2c/I2CResult.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_I2CRESULT_H
+#define RPIHWCTRL_I2C_I2CRESULT_H
+
+namespace RPiHWCtrl {
+
+/**
+ * @class I2CStatus
+ *
+ * @brief The outcome of a register operation which does not throw
+ *
+ * @details
+ * The try methods of the I2CTransaction (for example tryReadRegister()) return
+ * this instead of throwing, so failing operations cost no allocation. This is
+ * useful on noisy buses, where failures are expected and simply retried later.
+ */
+struct I2CStatus {
+  /// The errno of the failure, or zero on success
+  int err_code = 0;
+  /// The register of the operation
+  int register_address = -1;
+  /// The number of the times the operation was attempted
+  unsigned attempts = 0;
+
+  /// Returns true if the operation succeeded
+  bool ok() const {
+    return err_code == 0;
+  }
+
+  explicit operator bool() const {
+    return ok();
+  }
+};
+
+/// The outcome of a register read which does not throw. The value is valid
+/// only if the read succeeded.
+template <typename T>
+struct I2CResult : public I2CStatus {
+  T value {};
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_I2CRESULT_H */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* 
+ * @file i2c/I2CRetryPolicy.h
+ * @author nikoapos
+ */
+
+#ifndef RPIHWCTRL_I2C_I2CRETRYPOLICY_H
+#define RPIHWCTRL_I2C_I2CRETRYPOLICY_H
+
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <algorithm>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class I2CRetryPolicy
+ *
+ * @brief How the I2C operations are retried when they fail
+ *
+ * @details
+ * Only transient failures are retried, like a device which did not acknowledge
+ * (typical for devices busy with a conversion, or for a noisy bus). Between
+ * the attempts the thread sleeps, starting with the initial backoff and
+ * multiplying it with the backoff factor after each attempt, up to the maximum
+ * backoff. The bus stays locked while sleeping.
+ *
+ * The default policy does not retry.
+ */
+struct I2CRetryPolicy {
+  /// The maximum number of the attempts of an operation (including the first)
+  unsigned max_attempts = 1;
+  /// The time to wait before the second attempt
+  std::chrono::microseconds initial_backoff {100};
+  /// The factor the wait time is multiplied with after each attempt
+  unsigned backoff_factor = 2;
+  /// The maximum time to wait between two attempts
+  std::chrono::microseconds max_backoff {10000};
+
+  /// Returns true if a failure with the given errno is worth retrying
+  static bool isTransient(int err_code) {
+    return err_code == EREMOTEIO || err_code == ENXIO || err_code == EIO
+           || err_code == EAGAIN || err_code == ETIMEDOUT;
+  }
+
+  /**
+   * @brief Executes an operation with this policy
+   *
+   * @param operation
+   *    Called for each attempt, it returns zero on success or the errno of
+   *    the failure
+   * @param attempts
+   *    If not null, it is set to the number of the attempts
+   * @return
+   *    The errno of the last attempt, or zero on success
+   */
+  template <typename Operation>
+  int run(Operation&& operation, unsigned* attempts=nullptr) const {
+    auto backoff = initial_backoff;
+    unsigned attempt = 1;
+    int err_code = operation();
+    while (err_code != 0 && attempt < max_attempts && isTransient(err_code)) {
+      std::this_thread::sleep_for(backoff);
+      backoff = std::min(backoff * backoff_factor, max_backoff);
+      ++attempt;
+      err_code = operation();
+    }
+    if (attempts != nullptr) {
+      *attempts = attempt;
+    }
+    return err_code;
+  }
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif /* RPIHWCTRL_I2C_I2CRETRYPOLICY_H */
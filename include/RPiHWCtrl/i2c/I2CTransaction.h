@@ -16,38 +16,332 @@
  */
 
 /* 
- * @file i2cI2CTransaction.h
+ * @file i2c/I2CTransaction.h
  * @author nikoapos
  */
 
 #ifndef RPIHWCTRL_I2C_I2CTRANSACTION_H
 #define RPIHWCTRL_I2C_I2CTRANSACTION_H
 
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <RPiHWCtrl/i2c/Endianness.h>
+#include <RPiHWCtrl/i2c/I2CResult.h>
+#include <RPiHWCtrl/i2c/I2CRetryPolicy.h>
+#include <RPiHWCtrl/Interfaces/exceptions.h>
 
 namespace RPiHWCtrl {
 
+/**
+ * @class I2CTransaction
+ * 
+ * @brief Exclusive access to a device of an I2CBus
+ * 
+ * @details
+ * The bus is locked for as long as the transaction exists, so the register
+ * methods of the transaction do not need to check anything before they access
+ * the device. The transaction can also queue many reads and writes and send
+ * them with the submit() method. When the adapter supports it, all the queued
+ * operations are sent with a single I2C_RDWR system call, with repeated starts
+ * between the messages.
+ * 
+ * Reads and writes of more than one byte use the auto-increment of the device
+ * register address, so they access consecutive registers (burst access). A
+ * single read can be at most 8192 bytes long and a single write at most 8191
+ * bytes (plus the register address), which is the limit of the i2c-dev
+ * driver. Longer accesses fail with EMSGSIZE without accessing the bus.
+ * 
+ * Writes can also be deferred (see deferWrite()), in which case deferred
+ * writes to consecutive registers are merged into a single burst write. This
+ * turns the long register sequences of device initializations into a few
+ * messages, sent with a single system call by commit().
+ * 
+ * The register methods throw when they fail. Each of them has a try variant
+ * (for example tryReadRegister()) which returns an I2CStatus instead, for
+ * callers which expect failures and do not want to pay for an exception. Both
+ * retry transient failures according to the I2CRetryPolicy of the bus.
+ */
 class I2CTransaction {
   
 public:
   
-  I2CTransaction(std::mutex& mutex) : m_lock(mutex) {
+  /**
+   * @brief Locks the bus for accessing the device at the given address
+   * 
+   * @details
+   * Transactions are normally created by I2CBus::startTransaction(). The owner
+   * is set to the calling thread while the transaction exists, so the
+   * register methods of the I2CBus can check that they are called within a
+   * transaction.
+   */
+  I2CTransaction(std::mutex& mutex, std::atomic<std::thread::id>& owner, int bus_file,
+                 std::uint8_t address, bool combined_transfers,
+                 const I2CRetryPolicy& retry_policy=I2CRetryPolicy{})
+          : m_lock(mutex), m_owner(&owner), m_bus_file(bus_file), m_address(address),
+            m_combined_transfers(combined_transfers), m_retry_policy(retry_policy) {
+    m_owner->store(std::this_thread::get_id(), std::memory_order_relaxed);
   }
   
   I2CTransaction(I2CTransaction&& other) = default;
   I2CTransaction& operator=(I2CTransaction&& other) = default;
   
+  /// Flushes any deferred writes and unlocks the bus. The other queued
+  /// operations are discarded, because the buffers of the reads might not
+  /// exist any more. Errors of the flush are ignored, so commit() should be
+  /// called explicitly if they matter.
   virtual ~I2CTransaction() {
-    m_lock.unlock();
+    // A moved transaction does not own the lock any more
+    if (m_lock.owns_lock()) {
+      if (m_deferred_writes) {
+        try {
+          flushDeferredWrites();
+        } catch (const I2CException&) {
+        }
+      }
+      m_owner->store(std::thread::id {}, std::memory_order_relaxed);
+      m_lock.unlock();
+    }
+  }
+  
+  /// Reads Size consecutive registers, starting from the given one
+  template <std::size_t Size>
+  std::array<std::uint8_t, Size> readRegisterAsArray(std::uint8_t register_address) {
+    std::array<std::uint8_t, Size> buffer;
+    auto status = tryReadRegisterBytes(register_address, buffer.data(), Size);
+    if (!status) {
+      throw I2CReadRegisterException(register_address, status.err_code);
+    }
+    return buffer;
+  }
+  
+  /// Reads size consecutive registers in the buffer, without throwing
+  I2CStatus tryReadRegisterBytes(std::uint8_t register_address, std::uint8_t* buffer,
+                                 std::size_t size) {
+    return readRegisterBytes(m_bus_file, m_address, m_combined_transfers, m_retry_policy,
+                             register_address, buffer, size);
+  }
+  
+  /// Reads a multi-byte register without throwing (see readRegister())
+  template <typename T, Endianness E=Endianness::BIG>
+  I2CResult<T> tryReadRegister(std::uint8_t register_address) {
+    std::array<std::uint8_t, sizeof(T)> buffer;
+    I2CResult<T> result;
+    static_cast<I2CStatus&>(result) = tryReadRegisterBytes(register_address,
+                                                           buffer.data(), buffer.size());
+    if (result) {
+      result.value = fromDeviceBytes<E, T>(buffer.data());
+    }
+    return result;
+  }
+  
+  /**
+   * @brief Reads a multi-byte register
+   * 
+   * @tparam T
+   *    The type of the register value
+   * @tparam E
+   *    The byte order of the register in the device
+   */
+  template <typename T, Endianness E=Endianness::BIG>
+  T readRegister(std::uint8_t register_address) {
+    auto buffer = readRegisterAsArray<sizeof(T)>(register_address);
+    return fromDeviceBytes<E, T>(buffer.data());
   }
   
+  /// Reads count samples from consecutive registers with a single burst read,
+  /// and converts them in place to the byte order of the host
+  template <typename T, Endianness E=Endianness::BIG>
+  void readSamples(std::uint8_t register_address, T* buffer, std::size_t count) {
+    auto status = tryReadRegisterBytes(register_address, reinterpret_cast<std::uint8_t*>(buffer),
+                                       count * sizeof(T));
+    if (!status) {
+      throw I2CReadRegisterException(register_address, status.err_code);
+    }
+    fromDeviceInPlace<E>(buffer, count);
+  }
+  
+  /**
+   * @brief Writes a multi-byte register
+   * 
+   * @tparam T
+   *    The type of the register value
+   * @tparam E
+   *    The byte order of the register in the device
+   */
+  template <typename T, Endianness E=Endianness::BIG>
+  void writeRegister(std::uint8_t register_address, T value) {
+    auto status = tryWriteRegister<T, E>(register_address, value);
+    if (!status) {
+      throw I2CWriteRegisterException<T>(register_address, value, status.err_code);
+    }
+  }
+  
+  /// Writes a multi-byte register without throwing (see writeRegister())
+  template <typename T, Endianness E=Endianness::BIG>
+  I2CStatus tryWriteRegister(std::uint8_t register_address, T value) {
+    std::array<std::uint8_t, sizeof(T) + 1> buffer;
+    buffer[0] = register_address;
+    toDeviceBytes<E>(value, buffer.data() + 1);
+    return writeMessage(m_bus_file, m_address, m_combined_transfers, m_retry_policy,
+                        buffer.data(), buffer.size());
+  }
+  
+  /**
+   * @brief Queues the read of size consecutive registers
+   * 
+   * @details
+   * The buffer must stay valid until submit() is called, which fills it.
+   * 
+   * @param register_address
+   *    The address of the first register to read
+   * @param buffer
+   *    The buffer to read the values of the registers into
+   * @param size
+   *    The number of bytes to read
+   */
+  I2CTransaction& queueRead(std::uint8_t register_address, std::uint8_t* buffer,
+                            std::size_t size);
+  
+  /**
+   * @brief Queues the write of size consecutive registers
+   * 
+   * @details
+   * The data are copied, so the caller does not need to keep them.
+   * 
+   * @param register_address
+   *    The address of the first register to write
+   * @param data
+   *    The values to write to the registers
+   * @param size
+   *    The number of bytes to write
+   */
+  I2CTransaction& queueWrite(std::uint8_t register_address, const std::uint8_t* data,
+                             std::size_t size);
+  
+  /**
+   * @brief Defers the write of size consecutive registers
+   * 
+   * @details
+   * The write is queued like with queueWrite(), but if the previous queued
+   * operation is a deferred write which ends just before the given register,
+   * the data are appended to it, so both are sent as a single burst write.
+   * The deferred writes are sent by commit() or submit(), or when the
+   * transaction ends.
+   * 
+   * The device must auto-increment its register address for burst writes.
+   * Deferred writes should only set registers which have no side effects,
+   * because a failed batch of them may be sent again (see submit()).
+   */
+  I2CTransaction& deferWrite(std::uint8_t register_address, const std::uint8_t* data,
+                             std::size_t size);
+  
+  /// Defers the write of a multi-byte register (see deferWrite())
+  template <typename T, Endianness E=Endianness::BIG>
+  I2CTransaction& deferWriteRegister(std::uint8_t register_address, T value) {
+    std::array<std::uint8_t, sizeof(T)> buffer;
+    toDeviceBytes<E>(value, buffer.data());
+    return deferWrite(register_address, buffer.data(), buffer.size());
+  }
+  
+  /// Returns the number of the queued operations (merged writes count once)
+  std::size_t queuedOperations() const {
+    return m_operations.size();
+  }
+  
+  /**
+   * @brief Sends all the queued operations to the device
+   * 
+   * @details
+   * The queue is empty when the method returns, even if it fails. When the
+   * transaction ends, the deferred writes which were not submitted are sent
+   * and the other operations are discarded.
+   * 
+   * Failed batches are retried according to the I2CRetryPolicy of the bus.
+   * When a batch which contains only deferred writes still fails, its writes
+   * are sent again one by one to find the failing one, and merged writes are
+   * split back to the original writes, so the exception reports the register
+   * which failed. The deferred writes are assumed to be idempotent for this,
+   * as they may reach the device more than once. Batches with reads or
+   * immediate writes are never sent again, and the exception of a failed
+   * combined transfer does not report a register.
+   * 
+   * @throws I2CTransferException
+   *    If the transfer fails, with the first register of the failing operation
+   *    when it is known
+   */
+  void submit();
+  
+  /// Sends the deferred writes and all the other queued operations. It is the
+  /// same as submit(), but makes clear that deferred writes are flushed.
+  void commit();
+  
+  /// Removes all the queued operations, including the deferred writes,
+  /// without sending them
+  void discard();
+  
 private:
   
+  struct Operation {
+    std::uint8_t* read_buffer;
+    // The offset of the register address and of the data to write in the
+    // m_write_data. The data of reads contain only the register address.
+    std::size_t data_offset;
+    std::size_t size;
+    // If the operation is a deferred write, which can be extended
+    bool deferred;
+    // The sizes of the deferred writes merged in the operation, in the
+    // m_merged_sizes. Other operations have no parts.
+    std::size_t first_part;
+    std::size_t part_count;
+  };
+  
+  friend class I2CBus;
+  
+  // Writes the register address and reads size bytes from the device. These
+  // are static so the compatibility methods of the I2CBus can use them too.
+  static I2CStatus readRegisterBytes(int bus_file, std::uint8_t address,
+                                     bool combined_transfers,
+                                     const I2CRetryPolicy& retry_policy,
+                                     std::uint8_t register_address, std::uint8_t* buffer,
+                                     std::size_t size);
+  
+  // Writes the given message (the register address followed by the data) to
+  // the device
+  static I2CStatus writeMessage(int bus_file, std::uint8_t address, bool combined_transfers,
+                                const I2CRetryPolicy& retry_policy,
+                                const std::uint8_t* message, std::size_t size);
+  
+  void submitSeparately(const std::vector<Operation>& queue,
+                        std::vector<std::uint8_t>& write_data,
+                        const std::vector<std::size_t>& merged_sizes);
+  
+  // Sends one by one the deferred writes merged in the given operation, and
+  // throws with the register of the first one which fails
+  void isolateMergedWrite(const Operation& op, const std::vector<std::uint8_t>& write_data,
+                          const std::vector<std::size_t>& merged_sizes,
+                          std::size_t operations, int err_code);
+  
+  // Submits only the deferred writes and discards the other operations
+  void flushDeferredWrites();
+  
   std::unique_lock<std::mutex> m_lock;
+  std::atomic<std::thread::id>* m_owner;
+  int m_bus_file;
+  std::uint8_t m_address;
+  bool m_combined_transfers;
+  I2CRetryPolicy m_retry_policy;
+  std::vector<Operation> m_operations {};
+  std::vector<std::uint8_t> m_write_data {};
+  std::vector<std::size_t> m_merged_sizes {};
+  bool m_deferred_writes = false;
   
 };
 
 } // end of namespace RPiHWCtrl
 
 #endif /* RPIHWCTRL_I2C_I2CTRANSACTION_H */
-
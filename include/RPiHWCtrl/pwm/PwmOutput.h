@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file PwmOutput.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_PWM_PWMOUTPUT_H
+#define RPIHWCTRL_PWM_PWMOUTPUT_H
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <RPiHWCtrl/Interfaces/Output.h>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class PwmOutput
+ *
+ * @brief Output controlling the duty cycle of a hardware PWM channel
+ *
+ * @details
+ * The channel is accessed via the sysfs PWM class of the kernel. The channel is
+ * exported (if it is not already) when the object is constructed and it is
+ * unexported when the object is destroyed. The period and duty_cycle files are
+ * kept open and the last written values are cached, so a write which does not
+ * change anything costs nothing and a write which changes only the duty cycle
+ * costs a single pwrite() call.
+ *
+ * The kernel rejects a duty cycle longer than the period, so when both change
+ * together (with the update() method) they are written in the order which
+ * keeps every intermediate state valid.
+ */
+class PwmOutput : public Output<double> {
+
+public:
+
+  /// The default directory of the sysfs PWM class
+  static constexpr const char* default_sysfs_root = "/sys/class/pwm";
+
+  /**
+   * @brief Creates a PwmOutput for the given PWM channel
+   *
+   * @details
+   * The channel is enabled with the given period and a zero duty cycle.
+   *
+   * @param channel
+   *    The number of the channel of the PWM chip
+   * @param period
+   *    The period of the PWM signal
+   * @param chip
+   *    The number of the PWM chip
+   * @param sysfs_root
+   *    The directory of the sysfs PWM class. It can be set to a different
+   *    directory for testing against a fake tree.
+   *
+   * @throws PwmException
+   *    If the channel cannot be exported or configured
+   */
+  PwmOutput(int channel, std::chrono::nanoseconds period=std::chrono::milliseconds(1),
+            int chip=0, const std::string& sysfs_root=default_sysfs_root);
+
+  PwmOutput(const PwmOutput&) = delete;
+  PwmOutput& operator=(const PwmOutput&) = delete;
+
+  /// Disables and unexports the channel
+  virtual ~PwmOutput();
+
+  /// Sets the duty cycle, as a fraction of the period (0 to 1)
+  void writeValue(const double& duty) override;
+
+  /**
+   * @brief Sets the period and the duty cycle together
+   *
+   * @param period
+   *    The new period of the PWM signal
+   * @param duty
+   *    The duty cycle, as a fraction of the new period (0 to 1)
+   *
+   * @throws PwmException
+   *    If writing to the sysfs files fails
+   */
+  void update(std::chrono::nanoseconds period, double duty);
+
+  /// Returns the current period
+  std::chrono::nanoseconds period() const {
+    return std::chrono::nanoseconds(m_period_ns);
+  }
+
+  /// Returns the current duty cycle, as a fraction of the period
+  double dutyCycle() const {
+    return m_period_ns == 0 ? 0. : double(m_duty_ns) / m_period_ns;
+  }
+
+  /// Enables or disables the output signal
+  void setEnabled(bool enabled);
+
+private:
+
+  std::string channelDir() const;
+  void release();
+  void writePeriod(std::uint64_t period_ns);
+  void writeDuty(std::uint64_t duty_ns);
+
+  int m_channel;
+  std::string m_chip_dir;
+  bool m_exported = false;
+  int m_period_fd = -1;
+  int m_duty_fd = -1;
+  int m_enable_fd = -1;
+  std::uint64_t m_period_ns = 0;
+  std::uint64_t m_duty_ns = 0;
+  bool m_enabled = false;
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_PWM_PWMOUTPUT_H
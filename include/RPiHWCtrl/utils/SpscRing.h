@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file SpscRing.h
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#ifndef RPIHWCTRL_UTILS_SPSCRING_H
+#define RPIHWCTRL_UTILS_SPSCRING_H
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+
+namespace RPiHWCtrl {
+
+/**
+ * @class SpscRing
+ *
+ * @brief Bounded lock-free queue for a single producer and a single consumer
+ *
+ * @details
+ * All the memory is allocated at construction, so pushing and popping never
+ * allocate and never block. The tryPush() method must be called only from the
+ * producer thread and the tryPop() only from the consumer thread. The same
+ * applies to the zero-copy methods writeSpan() and commitWrite() (producer)
+ * and readSpan() and consume() (consumer).
+ *
+ * @tparam T
+ *    The type of the elements. Must be default constructible and copy
+ *    assignable.
+ */
+template <typename T>
+class SpscRing {
+
+public:
+
+  /// Creates a ring which can keep at least the given number of elements (the
+  /// capacity is rounded up to the next power of two)
+  explicit SpscRing(std::size_t capacity)
+          : m_mask(roundUpToPowerOfTwo(capacity) - 1), m_buffer(new T[m_mask + 1]) {
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  /// Adds an element at the end of the ring. Returns false if the ring is full.
+  bool tryPush(const T& value) {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+      return false;
+    }
+    m_buffer[tail & m_mask] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Removes the first element of the ring. Returns false if the ring is empty.
+  bool tryPop(T& value) {
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = m_buffer[head & m_mask];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Gives direct access to the free slots at the end of the ring
+   *
+   * @details
+   * This allows the producer to construct the elements in place. Only the
+   * slots up to the end of the underlying buffer are returned, so if the ring
+   * wraps around the method must be called again after commitWrite().
+   *
+   * @param data
+   *    Set to the first free slot
+   * @return
+   *    The number of the contiguous free slots
+   */
+  std::size_t writeSpan(T*& data) {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    auto free = capacity() - (tail - m_head.load(std::memory_order_acquire));
+    auto index = tail & m_mask;
+    data = &m_buffer[index];
+    return std::min(free, capacity() - index);
+  }
+
+  /// Makes the given number of slots returned by writeSpan() visible to the
+  /// consumer
+  void commitWrite(std::size_t count) {
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  /**
+   * @brief Gives direct access to the elements at the beginning of the ring
+   *
+   * @details
+   * The elements stay valid until they are released with consume(). As with
+   * writeSpan(), only the elements up to the end of the underlying buffer are
+   * returned.
+   *
+   * @param data
+   *    Set to the first element
+   * @return
+   *    The number of the contiguous elements
+   */
+  std::size_t readSpan(const T*& data) const {
+    auto head = m_head.load(std::memory_order_relaxed);
+    auto available = m_tail.load(std::memory_order_acquire) - head;
+    auto index = head & m_mask;
+    data = &m_buffer[index];
+    return std::min(available, capacity() - index);
+  }
+
+  /// Removes the given number of elements from the beginning of the ring
+  void consume(std::size_t count) {
+    m_head.store(m_head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  /// Returns the number of the elements in the ring. If it is called while the
+  /// other thread modifies the ring the result is approximate.
+  std::size_t size() const {
+    auto head = m_head.load(std::memory_order_acquire);
+    return m_tail.load(std::memory_order_acquire) - head;
+  }
+
+  /// Returns the maximum number of elements the ring can keep
+  std::size_t capacity() const {
+    return m_mask + 1;
+  }
+
+private:
+
+  static std::size_t roundUpToPowerOfTwo(std::size_t value) {
+    std::size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  std::size_t m_mask;
+  std::unique_ptr<T[]> m_buffer;
+
+  // The head is modified only by the consumer and the tail only by the
+  // producer. We keep them in different cache lines, so the two threads do not
+  // invalidate each other's cache.
+  std::atomic<std::size_t> m_head {0};
+  char m_padding[64];
+  std::atomic<std::size_t> m_tail {0};
+
+};
+
+} // end of namespace RPiHWCtrl
+
+#endif // RPIHWCTRL_UTILS_SPSCRING_H
@@ -56,12 +56,12 @@
  * by turning the switch on and off again. The program will stop after 10 seconds.
  */
 
-#include <vector> // for std::vector
+#include <cstdint> // for std::uint64_t
 #include <chrono> // for std::chrono_literals
 #include <thread> // for std::this_thread
 #include <atomic>
 #include <RPiHWCtrl/gpio/GpioInput.h>
-#include <RPiHWCtrl/gpio/GpioOutput.h>
+#include <RPiHWCtrl/gpio/GpioBank.h>
 
 // We introduce the symbols from std::chrono_literals so we can write time
 // like 500ms (500 milliseconds)
@@ -99,15 +99,12 @@ int main() {
   // Handling the LEDs
   //
   
-  // Create a vector with the controllers for the GPIOs 16, 5, 25, 22 and 4
-  std::vector<RPiHWCtrl::GpioOutput> leds {};
-  leds.emplace_back(16);
-  leds.emplace_back(5);
-  leds.emplace_back(25);
-  leds.emplace_back(22);
-  leds.emplace_back(4);
+  // Create a bank controlling the GPIOs 16, 5, 25, 22 and 4 all together. The
+  // state of the LEDs is represented as a bitmask, where the bit i corresponds
+  // to the i-th GPIO of the list.
+  RPiHWCtrl::GpioBank leds {{16, 5, 25, 22, 4}};
   
-  // The i identifies the index of the current LED in the vector
+  // The i identifies the index of the current LED in the bank
   unsigned int i = 0;
   
   // The direction of the movement on the LED vector
@@ -116,11 +113,6 @@ int main() {
   // Each iteration lasts 100ms, which is a total of 10s
   for (int l = 0; l < 100; ++l) {
     
-    // First turn off all the LEDs
-    for (auto& led : leds) {
-      led.writeValue(false);
-    }
-    
     // Move i to the next LED in the direction we are moving
     i += direction;
     // If we are out of the vector bounds change the direction and move the i
@@ -130,10 +122,10 @@ int main() {
       i += 2 * direction;
     }
     
-    // If the switch is on, light the LED at position i, otherwise let it off
-    if (switch_state) {
-      leds[i].writeValue(true);
-    }
+    // If the switch is on, light the LED at position i, otherwise let it off.
+    // All the other LEDs are turned off with the same write, so they all change
+    // state at the same time.
+    leds.writeValue(switch_state ? (std::uint64_t{1} << i) : 0);
     
     // Sleep for 100 ms
     std::this_thread::sleep_for(100ms);
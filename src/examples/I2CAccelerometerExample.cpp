@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file I2CAccelerometerExample.cpp
+ * @author nikoapos
+ */
+
+/*
+ * Description
+ * -----------
+ *
+ * Example of how to write a small driver for an I2C device, using the MPU-6050
+ * accelerometer and gyroscope. The registers of the device are described once
+ * as types (I2CRegister and I2CBitField), so the code accessing them is
+ * generated at compile time. The example shows two ways of reading the
+ * acceleration:
+ *
+ * - Reading the current values with an I2CRegisterGroup, which reads the three
+ *      axes and the temperature with a single burst read
+ * - Streaming the samples collected in the FIFO of the device with an
+ *      I2CFifoStream, which reads them in the background
+ *
+ * Hardware implementation
+ * -----------------------
+ * Materials:
+ *   - An MPU-6050 module
+ *
+ * Connections:
+ *   - Connect the VCC of the module to a 3.3V pin
+ *   - Connect the GND of the module to a GND pin
+ *   - Connect the SDA of the module to the GPIO-2 (SDA) pin
+ *   - Connect the SCL of the module to the GPIO-3 (SCL) pin
+ *
+ * Execution:
+ * Enable the I2C interface of the Raspberry Pi and run the example. It prints
+ * the current acceleration and temperature five times, and then the number of
+ * the samples streamed from the FIFO during two seconds and their average.
+ * Move the module while the example runs to see the values change.
+ */
+
+#include <iostream> // for std::cout
+#include <thread> // for std::this_thread
+#include <chrono> // for std::chrono_literals
+#include <RPiHWCtrl/i2c/I2CBus.h>
+#include <RPiHWCtrl/i2c/I2CRegister.h>
+#include <RPiHWCtrl/i2c/I2CFifoStream.h>
+
+using namespace std::chrono_literals;
+using namespace RPiHWCtrl;
+
+namespace {
+
+// The address of the device when its AD0 pin is low
+constexpr std::uint8_t address = 0x68;
+
+// The registers of the device we use. All the multi-byte registers are big
+// endian.
+using SampleRateDivider = I2CRegister<0x19, std::uint8_t>;
+using Config = I2CRegister<0x1A, std::uint8_t>;
+using LowPassFilter = I2CBitField<Config, 0, 3>;
+using FifoEnable = I2CRegister<0x23, std::uint8_t>;
+using AccelFifo = I2CBitField<FifoEnable, 3, 1>;
+using AccelX = I2CRegister<0x3B, std::int16_t, Endianness::BIG, RegisterAccess::READ_ONLY>;
+using AccelY = I2CRegister<0x3D, std::int16_t, Endianness::BIG, RegisterAccess::READ_ONLY>;
+using AccelZ = I2CRegister<0x3F, std::int16_t, Endianness::BIG, RegisterAccess::READ_ONLY>;
+using Temperature = I2CRegister<0x41, std::int16_t, Endianness::BIG, RegisterAccess::READ_ONLY>;
+using UserControl = I2CRegister<0x6A, std::uint8_t>;
+using FifoOn = I2CBitField<UserControl, 6, 1>;
+using FifoReset = I2CBitField<UserControl, 2, 1>;
+using PowerManagement = I2CRegister<0x6B, std::uint8_t>;
+using Sleep = I2CBitField<PowerManagement, 6, 1>;
+using FifoCount = I2CRegister<0x72, std::uint16_t, Endianness::BIG, RegisterAccess::READ_ONLY>;
+using WhoAmI = I2CRegister<0x75, std::uint8_t, Endianness::BIG, RegisterAccess::READ_ONLY>;
+
+// The registers are adjacent, so the group is read with a single burst
+using Measurement = I2CRegisterGroup<AccelX, AccelY, AccelZ, Temperature>;
+static_assert(Measurement::bursts() == 1, "The measurement should be a single burst");
+
+// With the default range of +-2g the acceleration has 16384 counts per g
+constexpr double counts_per_g = 16384.;
+
+} // end of anonymous namespace
+
+int main() {
+
+  auto bus = I2CBus::getSingleton();
+
+  //
+  // Configuring the device
+  //
+
+  {
+    auto transaction = bus->startTransaction(address);
+    if (WhoAmI::read(transaction) != 0x68) {
+      std::cout << "No MPU-6050 found at address 0x68" << std::endl;
+      return 1;
+    }
+
+    // Wake up the device, and set the sample rate to 1kHz / (1 + 9) = 100Hz
+    Sleep::write(transaction, 0);
+    LowPassFilter::write(transaction, 1);
+    SampleRateDivider::write(transaction, 9);
+  }
+
+  //
+  // Reading the current values
+  //
+
+  for (int i = 0; i < 5; ++i) {
+    auto transaction = bus->startTransaction(address);
+    auto values = Measurement::read(transaction);
+    std::cout << "Acceleration (g): " << std::get<0>(values) / counts_per_g << ", "
+              << std::get<1>(values) / counts_per_g << ", "
+              << std::get<2>(values) / counts_per_g << "  Temperature (C): "
+              << std::get<3>(values) / 340. + 36.53 << std::endl;
+    std::this_thread::sleep_for(500ms);
+  }
+
+  //
+  // Streaming the FIFO
+  //
+
+  // Each sample of the FIFO contains the three axes of the acceleration
+  {
+    auto transaction = bus->startTransaction(address);
+    AccelFifo::write(transaction, 1);
+    FifoReset::write(transaction, 1);
+    FifoOn::write(transaction, 1);
+  }
+
+  using Stream = I2CFifoStream<std::int16_t, 3>;
+  Stream::Config config;
+  config.address = address;
+  config.data_register = 0x74;
+  config.poll_interval = 50ms;
+  config.sample_period = 10ms;
+  config.max_burst = 32;
+  config.available = [](I2CTransaction& transaction) {
+    return std::size_t {FifoCount::read(transaction)} / 6;
+  };
+
+  std::size_t count = 0;
+  double sum[3] = {0., 0., 0.};
+  {
+    Stream stream {bus, config, 256};
+    for (int i = 0; i < 20; ++i) {
+      std::this_thread::sleep_for(100ms);
+      const Stream::Sample* samples;
+      std::size_t available;
+      while ((available = stream.readSpan(samples)) > 0) {
+        for (std::size_t s = 0; s < available; ++s) {
+          for (std::size_t axis = 0; axis < 3; ++axis) {
+            sum[axis] += samples[s].values[axis] / counts_per_g;
+          }
+        }
+        count += available;
+        stream.consume(available);
+      }
+    }
+    std::cout << "Streamed " << count << " samples (" << stream.stats().errors
+              << " failed bursts)" << std::endl;
+  }
+  if (count > 0) {
+    std::cout << "Average acceleration (g): " << sum[0] / count << ", "
+              << sum[1] / count << ", " << sum[2] / count << std::endl;
+  }
+
+  auto transaction = bus->startTransaction(address);
+  FifoOn::write(transaction, 0);
+
+}
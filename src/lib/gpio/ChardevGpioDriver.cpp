@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file ChardevGpioDriver.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <cerrno>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/ChardevGpioDriver.h>
+
+namespace RPiHWCtrl {
+
+namespace {
+
+constexpr const char* consumer_name = "RPiHWCtrl";
+
+// The flags of the input lines, which detect both rising and falling edges
+constexpr std::uint64_t input_flags = GPIO_V2_LINE_FLAG_INPUT
+                                    | GPIO_V2_LINE_FLAG_EDGE_RISING
+                                    | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+// The maximum number of events read with a single read() call
+constexpr std::size_t event_batch_size = 16;
+
+// The number of events the kernel buffers for each line, until we read them.
+// The kernel accepts buffers of up to GPIO_V2_LINES_MAX * 16 events per request.
+constexpr std::uint32_t events_per_line = 64;
+constexpr std::uint32_t max_event_buffer_size = GPIO_V2_LINES_MAX * 16;
+
+class ChardevGpioLines : public GpioLines {
+
+public:
+
+  ChardevGpioLines(int request_fd, const std::vector<int>& offsets, GpioDirection direction)
+          : m_request_fd(request_fd), m_offsets(offsets), m_direction(direction) {
+  }
+
+  virtual ~ChardevGpioLines() {
+    // Closing the request file releases the lines
+    close(m_request_fd);
+  }
+
+  std::size_t size() const override {
+    return m_offsets.size();
+  }
+
+  std::uint64_t readValues(std::uint64_t mask) override {
+    gpio_v2_line_values values {};
+    values.mask = mask;
+    if (ioctl(m_request_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+      throw GpioException() << "Failed to read GPIO line values: " << std::strerror(errno);
+    }
+    return values.bits;
+  }
+
+  void writeValues(std::uint64_t mask, std::uint64_t values) override {
+    gpio_v2_line_values line_values {};
+    line_values.mask = mask;
+    line_values.bits = values;
+    if (ioctl(m_request_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &line_values) < 0) {
+      throw GpioException() << "Failed to write GPIO line values: " << std::strerror(errno);
+    }
+  }
+
+  int eventFd() const override {
+    // Only the lines requested as inputs have edge detection enabled
+    return (m_direction == GpioDirection::INPUT) ? m_request_fd : -1;
+  }
+
+  short eventPollFlags() const override {
+    return POLLIN;
+  }
+
+  std::size_t readEvents(EdgeEvent* events, std::size_t max_events) override {
+    // Read as many events as we can with a single read() call. The kernel
+    // returns only whole events.
+    std::size_t count = std::min(max_events, m_event_buffer.size());
+    auto bytes = read(m_request_fd, m_event_buffer.data(), count * sizeof(gpio_v2_line_event));
+    if (bytes < 0) {
+      throw GpioException() << "Failed to read GPIO line events: " << std::strerror(errno);
+    }
+    count = bytes / sizeof(gpio_v2_line_event);
+    for (std::size_t i = 0; i < count; ++i) {
+      auto& event = m_event_buffer[i];
+      events[i].type = (event.id == GPIO_V2_LINE_EVENT_RISING_EDGE)
+                     ? EdgeEvent::Type::RISING : EdgeEvent::Type::FALLING;
+      events[i].timestamp_ns = event.timestamp_ns;
+      events[i].seqno = event.line_seqno;
+      events[i].line = lineIndex(event.offset);
+    }
+    return count;
+  }
+
+  void clearEvents() override {
+    pollfd pfd {m_request_fd, POLLIN, 0};
+    while (poll(&pfd, 1, 0) > 0) {
+      read(m_request_fd, m_event_buffer.data(), m_event_buffer.size() * sizeof(gpio_v2_line_event));
+    }
+  }
+
+  bool setDebounce(std::chrono::microseconds period) override {
+    // Only the input lines have edge detection to debounce
+    if (m_direction != GpioDirection::INPUT) {
+      return false;
+    }
+    // The new configuration replaces the old one, so we set again the flags
+    // the lines were requested with
+    gpio_v2_line_config config {};
+    config.flags = input_flags;
+    config.num_attrs = 1;
+    config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+    config.attrs[0].attr.debounce_period_us = period.count();
+    config.attrs[0].mask = (m_offsets.size() == 64) ? ~std::uint64_t{0}
+                                                    : (std::uint64_t{1} << m_offsets.size()) - 1;
+    return ioctl(m_request_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) == 0;
+  }
+
+private:
+
+  std::size_t lineIndex(std::uint32_t offset) const {
+    for (std::size_t i = 0; i < m_offsets.size(); ++i) {
+      if (std::uint32_t(m_offsets[i]) == offset) {
+        return i;
+      }
+    }
+    return 0;
+  }
+
+  int m_request_fd;
+  std::vector<int> m_offsets;
+  GpioDirection m_direction;
+  std::array<gpio_v2_line_event, event_batch_size> m_event_buffer;
+
+};
+
+} // end of anonymous namespace
+
+constexpr const char* ChardevGpioDriver::default_chip;
+
+ChardevGpioDriver::ChardevGpioDriver(const std::string& chip_path) : m_chip_path(chip_path) {
+  m_chip_fd = open(m_chip_path.c_str(), O_RDWR | O_CLOEXEC);
+  if (m_chip_fd < 0) {
+    throw GpioException() << "Failed to open GPIO chip " << m_chip_path << ": "
+                          << std::strerror(errno);
+  }
+}
+
+ChardevGpioDriver::~ChardevGpioDriver() {
+  close(m_chip_fd);
+}
+
+std::unique_ptr<GpioLines> ChardevGpioDriver::requestLines(const std::vector<int>& gpios,
+                                                           GpioDirection direction) {
+  if (gpios.size() > GPIO_V2_LINES_MAX) {
+    throw GpioException() << "Cannot request more than " << GPIO_V2_LINES_MAX
+                          << " GPIO lines at once";
+  }
+
+  // Prepare a single request for all the lines
+  gpio_v2_line_request request {};
+  for (std::size_t i = 0; i < gpios.size(); ++i) {
+    request.offsets[i] = gpios[i];
+  }
+  request.num_lines = gpios.size();
+  std::strncpy(request.consumer, consumer_name, sizeof(request.consumer) - 1);
+  if (direction == GpioDirection::INPUT) {
+    request.config.flags = input_flags;
+    // Use a bigger buffer than the kernel default, so bursts of edges are not
+    // lost while the events thread is busy. When the buffer overflows the
+    // kernel drops the oldest events, which shows as gap in the seqno.
+    request.event_buffer_size = std::min<std::uint32_t>(events_per_line * gpios.size(),
+                                                        max_event_buffer_size);
+  } else {
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+  }
+
+  if (ioctl(m_chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+    // The kernel does not tell us which line was busy, so we report the first
+    if (errno == EBUSY && !gpios.empty()) {
+      throw GpioAlreadyReserved(gpios.front());
+    }
+    throw GpioException() << "Failed to request GPIO lines from " << m_chip_path
+                          << ": " << std::strerror(errno);
+  }
+
+  return std::make_unique<ChardevGpioLines>(request.fd, gpios, direction);
+}
+
+} // end of namespace RPiHWCtrl
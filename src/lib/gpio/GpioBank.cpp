@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file GpioBank.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/SysfsGpioDriver.h>
+#include <RPiHWCtrl/gpio/GpioBank.h>
+
+namespace RPiHWCtrl {
+
+GpioBank::GpioBank(const std::vector<int>& gpios, GpioDirection direction)
+        : GpioBank(gpios, SysfsGpioDriver::getDefault(), direction) {
+}
+
+GpioBank::GpioBank(const std::vector<int>& gpios, std::shared_ptr<GpioDriver> driver,
+                   GpioDirection direction) : m_gpios(gpios) {
+
+  // Check that all the GPIO numbers are in the valid range
+  for (auto gpio_no : m_gpios) {
+    if (gpio_no < 2 || gpio_no > 27) {
+      throw BadGpioNumber(gpio_no);
+    }
+  }
+
+  // Reserve all the GPIO lines with a single request to the driver
+  m_lines = driver->requestLines(m_gpios, direction);
+
+}
+
+} // end of namespace RPiHWCtrl
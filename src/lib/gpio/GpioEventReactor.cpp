@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file GpioEventReactor.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <cstring>
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/GpioEventReactor.h>
+
+namespace RPiHWCtrl {
+
+namespace {
+
+constexpr int max_events = 16;
+
+} // end of anonymous namespace
+
+std::shared_ptr<GpioEventReactor> GpioEventReactor::getSingleton() {
+  static std::shared_ptr<GpioEventReactor> singleton = std::make_shared<GpioEventReactor>();
+  return singleton;
+}
+
+GpioEventReactor::GpioEventReactor() {
+  m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll_fd < 0) {
+    throw GpioException() << "Failed to create epoll instance: " << std::strerror(errno);
+  }
+
+  // The eventfd is used only for waking up the thread when the reactor is
+  // destroyed
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (m_wakeup_fd < 0) {
+    close(m_epoll_fd);
+    throw GpioException() << "Failed to create eventfd: " << std::strerror(errno);
+  }
+  epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.fd = m_wakeup_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &event);
+
+  m_thread = std::thread {&GpioEventReactor::run, this};
+}
+
+GpioEventReactor::~GpioEventReactor() {
+  {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_stopping = true;
+  }
+  std::uint64_t one = 1;
+  write(m_wakeup_fd, &one, sizeof(one));
+  m_thread.join();
+  close(m_wakeup_fd);
+  close(m_epoll_fd);
+}
+
+void GpioEventReactor::add(GpioLines& lines, std::function<void()> handler) {
+  int fd = lines.eventFd();
+  if (fd < 0) {
+    throw GpioException() << "The GPIO lines do not support edge events";
+  }
+  // The poll() flags of the lines have the same values with the epoll ones
+  add(fd, lines.eventPollFlags(), std::move(handler));
+}
+
+void GpioEventReactor::add(int fd, std::uint32_t events, std::function<void()> handler) {
+  std::lock_guard<std::mutex> lock {m_mutex};
+  if (m_entries.count(fd) != 0) {
+    throw GpioException() << "The file descriptor " << fd << " is already watched";
+  }
+  m_entries[fd] = Entry {std::move(handler), false};
+
+  epoll_event event {};
+  event.events = events;
+  event.data.fd = fd;
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    m_entries.erase(fd);
+    throw GpioException() << "Failed to watch file descriptor " << fd << ": "
+                          << std::strerror(errno);
+  }
+}
+
+void GpioEventReactor::remove(GpioLines& lines) {
+  remove(lines.eventFd());
+}
+
+void GpioEventReactor::remove(int fd) {
+  std::unique_lock<std::mutex> lock {m_mutex};
+  auto it = m_entries.find(fd);
+  if (it == m_entries.end()) {
+    return;
+  }
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+  // If the handler removes its own lines we cannot destroy it while it runs,
+  // so we leave it to the reactor thread to erase it after it returns
+  if (std::this_thread::get_id() == m_thread.get_id()) {
+    if (m_dispatching_fd == fd) {
+      it->second.removed = true;
+    } else {
+      m_entries.erase(it);
+    }
+    return;
+  }
+
+  // Wait for the handler to finish if it is currently running
+  m_dispatch_done.wait(lock, [this, fd]() { return m_dispatching_fd != fd; });
+  m_entries.erase(fd);
+}
+
+void GpioEventReactor::run() {
+  epoll_event events[max_events];
+  for (;;) {
+
+    // Wait without timeout. Only edge events and the destruction of the
+    // reactor can wake us up.
+    int count = epoll_wait(m_epoll_fd, events, max_events, -1);
+    if (count < 0) {
+      continue;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      int fd = events[i].data.fd;
+
+      std::unique_lock<std::mutex> lock {m_mutex};
+      if (m_stopping) {
+        return;
+      }
+
+      // The lines might have been removed after epoll_wait() returned
+      auto it = m_entries.find(fd);
+      if (it == m_entries.end() || it->second.removed) {
+        continue;
+      }
+
+      // Call the handler without holding the lock, so the handler can add and
+      // remove lines. The entry cannot be erased while we are dispatching it.
+      m_dispatching_fd = fd;
+      lock.unlock();
+      try {
+        it->second.handler();
+      } catch (...) {
+        // An exception from one handler must not stop the events of the rest
+        // of the lines, so we just drop it
+      }
+      lock.lock();
+      m_dispatching_fd = -1;
+      if (it->second.removed) {
+        m_entries.erase(it);
+      }
+      m_dispatch_done.notify_all();
+    }
+  }
+}
+
+} // end of namespace RPiHWCtrl
@@ -21,195 +21,252 @@
  */
 
 #include <poll.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <fstream>
-#include <chrono> // for std::chrono_literals
-#include <thread> // for std::this_thread
-#include <boost/filesystem.hpp>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <ctime>
 #include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/SysfsGpioDriver.h>
+#include <RPiHWCtrl/gpio/GpioEventReactor.h>
 #include <RPiHWCtrl/gpio/GpioInput.h>
 
-// We introduce the symbols from std::chrono_literals so we can write time
-// like 500ms (500 milliseconds)
-using namespace std::chrono_literals;
-
 namespace RPiHWCtrl {
 
 namespace {
 
-const std::string gpio_path {"/sys/class/gpio"};
+// The maximum number of events read at once from the driver
+constexpr std::size_t event_batch_size = 16;
+
+} // end of anonymous namespace
+
+GpioInput::GpioInput(int gpio_no) : GpioInput(gpio_no, SysfsGpioDriver::getDefault()) {
+}
 
+GpioInput::GpioInput(int gpio_no, std::shared_ptr<GpioDriver> driver)
+        : GpioInput(gpio_no, std::move(driver), GpioDirection::INPUT) {
 }
 
-GpioInput::GpioInput(int gpio_no) : m_gpio_no(gpio_no) {
+GpioInput::GpioInput(int gpio_no, std::shared_ptr<GpioDriver> driver, GpioDirection direction)
+        : m_gpio_no(gpio_no), m_event_buffer(event_batch_size) {
   
   // Check that we have a GPIO number in the valid range
   if (m_gpio_no < 2 || m_gpio_no > 27) {
     throw BadGpioNumber(m_gpio_no);
   }
   
-  // Construct the GPIO dir path and check that it is not already exported
-  m_gpio_dir = gpio_path + "/gpio" + std::to_string(m_gpio_no);
-  if (boost::filesystem::exists(m_gpio_dir)) {
-    throw GpioAlreadyReserved(gpio_no);
-  }
+  // Reserve the GPIO line from the driver
+  m_line = driver->requestLines({m_gpio_no}, direction);
   
-  // Export the GPIO by writing its number to the export file
-  {
-    std::ofstream export_file {gpio_path + "/export"};
-    export_file << m_gpio_no;
+}
+
+std::vector<GpioInput> GpioInput::createMany(const std::vector<int>& gpio_numbers,
+                                             std::shared_ptr<GpioDriver> driver) {
+  if (driver == nullptr) {
+    driver = SysfsGpioDriver::getDefault();
   }
-  
-  // Give some time to the driver to initialize everything
-  std::this_thread::sleep_for(50ms);
-  
-  // Check that the GPIO is exported correctly
-  if (!boost::filesystem::exists(m_gpio_dir)) {
-    throw GpioException() << "Failed to export GPIO " << m_gpio_no;
+  return createConcurrently<GpioInput>(gpio_numbers, std::move(driver));
+}
+
+GpioInput::GpioInput(GpioInput&& other) : GpioInput(std::move(other), other.stopForMove()) {
+}
+
+GpioInput::GpioInput(GpioInput&& other, bool restart)
+        : Observable<bool>(std::move(other)), m_line(std::move(other.m_line)),
+          m_gpio_no(other.m_gpio_no), m_edge_events(std::move(other.m_edge_events)),
+          m_debouncer(std::move(other.m_debouncer)),
+          m_event_buffer(std::move(other.m_event_buffer)) {
+  if (restart) {
+    start();
   }
-  
-  // Set the GPIO as input by writing to the direction file
-  {
-    std::ofstream direction_file {m_gpio_dir + "/direction"};
-    direction_file << "in";
+}
+
+GpioInput& GpioInput::operator=(GpioInput&& other) {
+  if (this == &other) {
+    return *this;
   }
   
-  // Set that both rising and falling edges will generate interrupts, which will
-  // make the poll() method to return
-  {
-    std::ofstream direction_file {m_gpio_dir + "/edge"};
-    direction_file << "both";
+  // Both objects are stopped before anything is moved, so the reactor does
+  // not use any of them while they change
+  stop();
+  bool restart = other.stopForMove();
+  Observable<bool>::operator=(std::move(other));
+  m_line = std::move(other.m_line);
+  m_gpio_no = other.m_gpio_no;
+  m_edge_events = std::move(other.m_edge_events);
+  m_debouncer = std::move(other.m_debouncer);
+  m_event_buffer = std::move(other.m_event_buffer);
+  if (restart) {
+    start();
   }
-  
-  // Create the value file string
-  m_value_file =m_gpio_dir + "/value";
-  
+  return *this;
+}
+
+bool GpioInput::stopForMove() {
+  bool started = m_reactor != nullptr;
+  stop();
+  return started;
 }
 
 GpioInput::~GpioInput() {
   
   // Check if the object was moved. In this case
   // we do nothing. The destructor of the other instance will clean everything.
-  if (m_observing_flag == nullptr) {
+  if (m_line == nullptr) {
     return;
   }
   
-  // Stop the observing thread if it is running
+  // Stop observing for events. The GPIO is released when the m_line is
+  // destroyed.
   stop();
-  
-  // Unexport the GPIO by writing its number to the unexport file
-  std::ofstream export_file {gpio_path + "/unexport"};
-  export_file << m_gpio_no;
 }
 
 bool GpioInput::readValue() {
-  std::ifstream in {m_value_file};
-  auto value = in.get();
-  return (value == '0') ? false : true;
+  return m_line->readValues(1) != 0;
 }
 
 bool GpioInput::blockUntilValueChange() {
-  pollfd pfd {open(m_value_file.c_str(), O_RDONLY), POLLPRI, 0};
-  
-  // First read everything so that any pending events are cleared
-  int count;
-  ioctl(pfd.fd, FIONREAD, &count);
-  for (int i = 0; i < count; ++i) {
-      char ch;
-      read(pfd.fd, &ch, 1);
+  pollfd pfd {m_line->eventFd(), m_line->eventPollFlags(), 0};
+  if (pfd.fd < 0) {
+    throw GpioException() << "GPIO " << m_gpio_no << " does not support edge events";
   }
   
-  // Run poll to block until the next event is available
-  poll(&pfd, 1, -1);
+  // First clear any pending events
+  m_line->clearEvents();
   
-  // Close the file descriptor we used for detecting the event and use the
+  // Run poll to block until the next event is available and use the
   // readValue() method to get the latest value
-  close(pfd.fd);
+  poll(&pfd, 1, -1);
+  m_line->clearEvents();
   return readValue();
 }
 
-namespace {
-
-class ValueChangeEventGenerator {
+void GpioInput::setDebounce(std::chrono::microseconds period, bool prefer_driver) {
+  if (m_reactor != nullptr) {
+    throw GpioException() << "Cannot change the debounce period of the started GPIO "
+                          << m_gpio_no;
+  }
   
-public:
-  ValueChangeEventGenerator(const std::string& value_file, std::atomic<bool>& observing_flag,
-                            std::function<void(const bool&)> notify_func)
-          : m_value_file(value_file), m_observing_flag(observing_flag), m_notify_func(notify_func) {
+  // Remove any previous debouncing, by the driver or by the user space filter
+  m_line->setDebounce(std::chrono::microseconds::zero());
+  m_debouncer.reset();
+  if (period == std::chrono::microseconds::zero()) {
+    return;
   }
   
-  void operator()() {
-    pollfd pfd {open(m_value_file.c_str(), O_RDONLY), POLLPRI, 0};
+  // Use the user space filter only if the driver cannot do the debouncing
+  if (!prefer_driver || !m_line->setDebounce(period)) {
+    m_debouncer = std::make_unique<EdgeDebouncer>(period);
+  }
+}
+
+void GpioInput::start() {
+  // If we are already observing there is nothing to do
+  if (m_reactor != nullptr) {
+    return;
+  }
+  
+  auto reactor = GpioEventReactor::getSingleton();
+  m_line->clearEvents();
   
-    // First read everything so that any pending events are cleared
-    int count;
-    ioctl(pfd.fd, FIONREAD, &count);
-    for (int i = 0; i < count; ++i) {
-        char ch;
-        read(pfd.fd, &ch, 1);
+  // If we use the user space filter we also need a timer, for reporting the
+  // edges when they settle. Both handlers run at the reactor thread, so they
+  // do not need any synchronization. The filter and the timer are ready
+  // before the line is registered, because the line handler uses them as soon
+  // as it is added.
+  if (m_debouncer != nullptr) {
+    m_debouncer->reset(readValue());
+    m_debounce_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_debounce_timer_fd < 0) {
+      throw GpioException() << "Failed to create the debounce timer of GPIO " << m_gpio_no;
     }
-    
-    // Start the observing loop
-    for (;;) {
-      
-      // Wait for half second for an event
-      auto event = poll(&pfd, 1, 500);
-      
-      // Check if we should terminate the thread. We do this before we notify
-      // the observers, as the thread has been canceled before the
-      // event happened, while we were waiting.
-      if (m_observing_flag.get() == false) {
-        break;
-      }
-      
-      // If there was no event continue with the next iteration
-      if (event == 0) {
-        continue;
-      }
-      
-      // Read the next event
-      unsigned char value;
-      read(pfd.fd, &value, 1);
-      lseek(pfd.fd, 0, SEEK_SET);
-      
-      // If we do not get 0 or 1 from the file just ignore the event
-      if (value == '0') {
-        m_notify_func(false);
-      } else if (value == '1') {
-        m_notify_func(true);
-      }
+    try {
+      reactor->add(m_debounce_timer_fd, EPOLLIN, [this]() {
+        std::uint64_t expirations;
+        read(m_debounce_timer_fd, &expirations, sizeof(expirations));
+        settleDebouncer();
+      });
+    } catch (const GpioException&) {
+      close(m_debounce_timer_fd);
+      m_debounce_timer_fd = -1;
+      throw;
     }
   }
-
-private:
   
-  std::string m_value_file;
-  std::reference_wrapper<std::atomic<bool>> m_observing_flag;
-  std::function<void(const bool&)> m_notify_func;
+  // Register the line to the shared reactor, which will call us from its thread
+  // every time there is an edge event
+  try {
+    if (m_debouncer == nullptr) {
+      reactor->add(*m_line, [this]() {
+        // Read all the pending events with one call and notify the observers
+        // for each of them
+        auto count = m_line->readEvents(m_event_buffer.data(), m_event_buffer.size());
+        for (std::size_t i = 0; i < count; ++i) {
+          deliverEvent(m_event_buffer[i]);
+        }
+      });
+    } else {
+      reactor->add(*m_line, [this]() {
+        debounceEvents();
+      });
+    }
+  } catch (const GpioException&) {
+    if (m_debounce_timer_fd >= 0) {
+      reactor->remove(m_debounce_timer_fd);
+      close(m_debounce_timer_fd);
+      m_debounce_timer_fd = -1;
+    }
+    throw GpioException() << "GPIO " << m_gpio_no << " does not support edge events";
+  }
   
-};
+  m_reactor = std::move(reactor);
+}
 
+void GpioInput::stop() {
+  // Remove the line from the reactor. When this returns the observers are not
+  // notified any more. If we are not observing we do nothing.
+  if (m_reactor != nullptr) {
+    m_reactor->remove(*m_line);
+    if (m_debounce_timer_fd >= 0) {
+      m_reactor->remove(m_debounce_timer_fd);
+      close(m_debounce_timer_fd);
+      m_debounce_timer_fd = -1;
+    }
+    m_reactor.reset();
+  }
 }
 
-void GpioInput::start() {
-  *m_observing_flag = true;
-  
-  auto notify_func = [this](const bool& value) {
-    notifyObservers(value);
-  };
+void GpioInput::deliverEvent(const EdgeEvent& event) {
+  m_edge_events.notifyObservers(event);
+  notifyObservers(event.type == EdgeEvent::Type::RISING);
+}
+
+void GpioInput::debounceEvents() {
+  auto count = m_line->readEvents(m_event_buffer.data(), m_event_buffer.size());
+  for (std::size_t i = 0; i < count; ++i) {
+    m_debouncer->onEdge(m_event_buffer[i]);
+  }
   
-  ValueChangeEventGenerator task {m_value_file, *m_observing_flag, notify_func};
-  m_observing_thread = std::make_unique<std::thread>(task);
-  m_observing_thread->detach();
+  // Move the timer to the time the last edge settles
+  itimerspec timer {};
+  std::uint64_t deadline = m_debouncer->deadline();
+  timer.it_value.tv_sec = deadline / 1000000000;
+  timer.it_value.tv_nsec = deadline % 1000000000;
+  timerfd_settime(m_debounce_timer_fd, TFD_TIMER_ABSTIME, &timer, nullptr);
 }
 
-void GpioInput::stop() {
-  // Stop the observing thread by setting the flag to false. We wait for the
-  // thread to finish. If the thread is not running we do nothing.
-  *m_observing_flag = false;
-  if (m_observing_thread != nullptr && m_observing_thread->joinable()) {
-    m_observing_thread->join();
+void GpioInput::settleDebouncer() {
+  // There might be edges we did not process yet, because the timer was handled
+  // first. We process them before we check if the pending edge settled.
+  pollfd pfd {m_line->eventFd(), m_line->eventPollFlags(), 0};
+  if (poll(&pfd, 1, 0) > 0) {
+    debounceEvents();
+  }
+  
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  EdgeEvent settled;
+  if (m_debouncer->settle(std::uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec, settled)) {
+    deliverEvent(settled);
   }
 }
 
@@ -20,20 +20,28 @@
  * @author Nikolaos Apostolakos <nikoapos@gmail.com>
  */
 
-#include <fstream>
+#include <RPiHWCtrl/gpio/SysfsGpioDriver.h>
 #include <RPiHWCtrl/gpio/GpioOutput.h>
 
 namespace RPiHWCtrl {
 
-GpioOutput::GpioOutput(int m_gpio_no) : GpioInput(m_gpio_no) {
-  // Set the GPIO as output by writing to the direction file
-  std::ofstream direction_file {m_gpio_dir + "/direction"};
-  direction_file << "out";
+GpioOutput::GpioOutput(int gpio_no) : GpioOutput(gpio_no, SysfsGpioDriver::getDefault()) {
+}
+
+GpioOutput::GpioOutput(int gpio_no, std::shared_ptr<GpioDriver> driver)
+        : GpioInput(gpio_no, std::move(driver), GpioDirection::OUTPUT) {
+}
+
+std::vector<GpioOutput> GpioOutput::createMany(const std::vector<int>& gpio_numbers,
+                                               std::shared_ptr<GpioDriver> driver) {
+  if (driver == nullptr) {
+    driver = SysfsGpioDriver::getDefault();
+  }
+  return createConcurrently<GpioOutput>(gpio_numbers, std::move(driver));
 }
 
 void GpioOutput::writeValue(const bool& value) {
-  std::ofstream out {m_value_file};
-  out << value;
+  m_line->writeValues(1, value ? 1 : 0);
 }
 
 } // end of namespace RPiHWCtrl
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file MmapGpioDriver.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/MmapGpioDriver.h>
+
+namespace RPiHWCtrl {
+
+namespace {
+
+// The offsets of the registers in the block, in 32 bit words. Each register
+// type is split in consecutive banks of 32 GPIOs (the function select registers
+// in banks of 10 GPIOs).
+constexpr std::size_t GPFSEL0 = 0;
+constexpr std::size_t GPSET0 = 7;
+constexpr std::size_t GPCLR0 = 10;
+constexpr std::size_t GPLEV0 = 13;
+
+// The number of the GPIOs controlled by the register block
+constexpr int GPIO_COUNT = 54;
+
+} // end of anonymous namespace
+
+class MmapGpioDriver::State {
+
+public:
+
+  State(volatile std::uint32_t* registers, void* mapping)
+          : registers(registers), m_mapping(mapping) {
+  }
+
+  ~State() {
+    if (m_mapping != nullptr) {
+      munmap(m_mapping, block_size);
+    }
+  }
+
+  volatile std::uint32_t* registers;
+
+  // Protects the reservations and the read-modify-write of the function
+  // select registers
+  std::mutex mutex {};
+  std::uint64_t reserved = 0;
+
+private:
+
+  void* m_mapping;
+
+};
+
+class MmapGpioDriver::Lines : public GpioLines {
+
+public:
+
+  Lines(std::shared_ptr<State> state, const std::vector<int>& gpios)
+          : m_state(std::move(state)), m_registers(m_state->registers), m_gpios(gpios) {
+  }
+
+  virtual ~Lines() {
+    std::lock_guard<std::mutex> lock {m_state->mutex};
+    for (auto gpio_no : m_gpios) {
+      m_state->reserved &= ~(std::uint64_t{1} << gpio_no);
+    }
+  }
+
+  std::size_t size() const override {
+    return m_gpios.size();
+  }
+
+  std::uint64_t readValues(std::uint64_t mask) override {
+    // Read both level registers once and pick the bits of our lines
+    std::uint64_t level = m_registers[GPLEV0]
+                        | (std::uint64_t{m_registers[GPLEV0 + 1]} << 32);
+    std::uint64_t values = 0;
+    for (std::size_t i = 0; i < m_gpios.size(); ++i) {
+      if ((mask >> i) & 1) {
+        values |= ((level >> m_gpios[i]) & 1) << i;
+      }
+    }
+    return values;
+  }
+
+  void writeValues(std::uint64_t mask, std::uint64_t values) override {
+    // Compute the bits to set and to clear for all the lines, so we write
+    // every register at most once
+    std::uint64_t set = 0;
+    std::uint64_t clear = 0;
+    for (std::size_t i = 0; i < m_gpios.size(); ++i) {
+      if ((mask >> i) & 1) {
+        if ((values >> i) & 1) {
+          set |= std::uint64_t{1} << m_gpios[i];
+        } else {
+          clear |= std::uint64_t{1} << m_gpios[i];
+        }
+      }
+    }
+    for (std::size_t bank = 0; bank < 2; ++bank) {
+      std::uint32_t bank_set = set >> (32 * bank);
+      std::uint32_t bank_clear = clear >> (32 * bank);
+      if (bank_set != 0) {
+        m_registers[GPSET0 + bank] = bank_set;
+      }
+      if (bank_clear != 0) {
+        m_registers[GPCLR0 + bank] = bank_clear;
+      }
+    }
+  }
+
+  int eventFd() const override {
+    return -1;
+  }
+
+  short eventPollFlags() const override {
+    return 0;
+  }
+
+  std::size_t readEvents(EdgeEvent*, std::size_t) override {
+    throw GpioException() << "Edge events are not supported by the memory mapped GPIO driver";
+  }
+
+  void clearEvents() override {
+  }
+
+private:
+
+  std::shared_ptr<State> m_state;
+  volatile std::uint32_t* m_registers;
+  std::vector<int> m_gpios;
+
+};
+
+constexpr const char* MmapGpioDriver::default_device;
+constexpr std::size_t MmapGpioDriver::block_size;
+
+MmapGpioDriver::MmapGpioDriver(const std::string& device) {
+  int fd = open(device.c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+  if (fd < 0) {
+    throw GpioException() << "Failed to open " << device << ": " << std::strerror(errno);
+  }
+  void* mapping = mmap(nullptr, block_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the file is closed
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw GpioException() << "Failed to map " << device << ": " << std::strerror(errno);
+  }
+  m_state = std::make_shared<State>(static_cast<volatile std::uint32_t*>(mapping), mapping);
+}
+
+MmapGpioDriver::MmapGpioDriver(volatile std::uint32_t* registers)
+        : m_state(std::make_shared<State>(registers, nullptr)) {
+}
+
+std::unique_ptr<GpioLines> MmapGpioDriver::requestLines(const std::vector<int>& gpios,
+                                                        GpioDirection direction) {
+  if (gpios.size() > 64) {
+    throw GpioException() << "Cannot request more than 64 GPIO lines at once";
+  }
+
+  std::lock_guard<std::mutex> lock {m_state->mutex};
+
+  // Check that all the lines are valid and free before we modify anything
+  std::uint64_t requested = 0;
+  for (auto gpio_no : gpios) {
+    if (gpio_no < 0 || gpio_no >= GPIO_COUNT) {
+      throw BadGpioNumber(gpio_no);
+    }
+    std::uint64_t bit = std::uint64_t{1} << gpio_no;
+    if ((m_state->reserved | requested) & bit) {
+      throw GpioAlreadyReserved(gpio_no);
+    }
+    requested |= bit;
+  }
+
+  // Set the function of each GPIO. Each function select register controls 10
+  // GPIOs, with 3 bits each (000 for input, 001 for output).
+  auto registers = m_state->registers;
+  for (auto gpio_no : gpios) {
+    std::size_t reg = GPFSEL0 + gpio_no / 10;
+    unsigned shift = (gpio_no % 10) * 3;
+    std::uint32_t function = (direction == GpioDirection::OUTPUT) ? 1 : 0;
+    registers[reg] = (registers[reg] & ~(std::uint32_t{7} << shift)) | (function << shift);
+  }
+
+  m_state->reserved |= requested;
+  return std::make_unique<Lines>(m_state, gpios);
+}
+
+} // end of namespace RPiHWCtrl
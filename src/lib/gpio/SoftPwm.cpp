@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file SoftPwm.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/SoftPwm.h>
+
+namespace RPiHWCtrl {
+
+namespace {
+
+constexpr std::int64_t ns_per_s = 1000000000;
+
+std::int64_t monotonicNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return std::int64_t{now.tv_sec} * ns_per_s + now.tv_nsec;
+}
+
+void armTimer(int timer_fd, std::int64_t deadline_ns) {
+  itimerspec spec {};
+  // A zero it_value disarms the timer, so a deadline at time zero is moved to
+  // the first nanosecond, which has passed anyway
+  deadline_ns = std::max<std::int64_t>(deadline_ns, 1);
+  spec.it_value.tv_sec = deadline_ns / ns_per_s;
+  spec.it_value.tv_nsec = deadline_ns % ns_per_s;
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void disarmTimer(int timer_fd) {
+  itimerspec spec {};
+  timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+} // end of anonymous namespace
+
+SoftPwm::SoftPwm(const std::vector<int>& gpios, std::shared_ptr<GpioDriver> driver,
+                 int realtime_priority, std::chrono::nanoseconds merge_window)
+        : m_bank(driver ? GpioBank{gpios, driver, GpioDirection::OUTPUT}
+                        : GpioBank{gpios, GpioDirection::OUTPUT}),
+          m_states(gpios.size()),
+          m_duties(new std::atomic<double>[gpios.size()]),
+          m_frequencies(new std::atomic<double>[gpios.size()]),
+          m_merge_window_ns(std::max<std::int64_t>(merge_window.count(), 0)) {
+
+  m_channels.reserve(gpios.size());
+  for (std::size_t i = 0; i < gpios.size(); ++i) {
+    m_channels.emplace_back(*this, i);
+    m_duties[i].store(0.);
+    m_frequencies[i].store(0.);
+  }
+  m_bank.writeMask(m_bank.fullMask(), 0);
+
+  m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (m_timer_fd < 0) {
+    throw GpioException() << "Failed to create timerfd: " << std::strerror(errno);
+  }
+  // The eventfd wakes up the thread when the settings of a channel change,
+  // so a disabled channel can start without waiting for the other channels
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (m_wakeup_fd < 0) {
+    close(m_timer_fd);
+    throw GpioException() << "Failed to create eventfd: " << std::strerror(errno);
+  }
+
+  m_thread = std::thread {&SoftPwm::run, this};
+
+  if (realtime_priority > 0) {
+    sched_param param {};
+    param.sched_priority = realtime_priority;
+    m_realtime = pthread_setschedparam(m_thread.native_handle(), SCHED_FIFO, &param) == 0;
+  }
+}
+
+SoftPwm::~SoftPwm() {
+  m_stop = true;
+  wake();
+  m_thread.join();
+  close(m_wakeup_fd);
+  close(m_timer_fd);
+  try {
+    m_bank.writeMask(m_bank.fullMask(), 0);
+  } catch (...) {
+    // Destructors must not throw, and there is nothing else we can do
+  }
+}
+
+void SoftPwm::setDuty(std::size_t channel, double duty) {
+  if (channel >= size()) {
+    throw GpioException() << "Invalid PWM channel " << channel;
+  }
+  m_duties[channel].store(std::min(std::max(duty, 0.), 1.));
+  wake();
+}
+
+void SoftPwm::setFrequency(std::size_t channel, double frequency) {
+  if (channel >= size()) {
+    throw GpioException() << "Invalid PWM channel " << channel;
+  }
+  if (frequency < 0 || frequency > ns_per_s) {
+    throw GpioException() << "Invalid PWM frequency " << frequency << "Hz";
+  }
+  m_frequencies[channel].store(frequency);
+  wake();
+}
+
+SoftPwm::Stats SoftPwm::stats() const {
+  Stats result;
+  result.wakeups = m_wakeups.load(std::memory_order_relaxed);
+  result.writes = m_writes.load(std::memory_order_relaxed);
+  result.missed_periods = m_missed_periods.load(std::memory_order_relaxed);
+  result.last_latency_ns = m_last_latency.load(std::memory_order_relaxed);
+  result.max_latency_ns = m_max_latency.load(std::memory_order_relaxed);
+  result.mean_latency_ns = (result.wakeups == 0) ? 0
+          : m_total_latency.load(std::memory_order_relaxed) / std::int64_t(result.wakeups);
+  return result;
+}
+
+void SoftPwm::wake() {
+  std::uint64_t one = 1;
+  write(m_wakeup_fd, &one, sizeof(one));
+}
+
+void SoftPwm::processEdge(std::size_t channel, std::int64_t now,
+                          std::uint64_t& mask, std::uint64_t& values) {
+  auto& state = m_states[channel];
+  bool value = false;
+
+  if (state.off_edge_next) {
+    state.next_edge = state.period_start + state.period_ns;
+    state.off_edge_next = false;
+
+  } else {
+    // This is the start of a new period, so it is the only place where the new
+    // settings are applied
+    double frequency = m_frequencies[channel].load();
+    if (frequency <= 0) {
+      state.active = false;
+    } else {
+      state.period_ns = std::max<std::int64_t>(ns_per_s / frequency, 1);
+      state.on_ns = m_duties[channel].load() * state.period_ns;
+      state.period_start = state.next_edge;
+
+      // If we are late by more than a period we restart the timeline from now,
+      // instead of producing a burst of short periods to catch up
+      if (now - state.period_start > state.period_ns) {
+        state.period_start = now;
+        m_missed_periods.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      value = state.on_ns > 0;
+      if (state.on_ns > 0 && state.on_ns < state.period_ns) {
+        state.next_edge = state.period_start + state.on_ns;
+        state.off_edge_next = true;
+      } else {
+        state.next_edge = state.period_start + state.period_ns;
+      }
+    }
+  }
+
+  // Channels with 0% or 100% duty cycle have no edges, so we write only the
+  // channels which change value
+  if (value != state.value) {
+    state.value = value;
+    mask |= std::uint64_t{1} << channel;
+    if (value) {
+      values |= std::uint64_t{1} << channel;
+    }
+  }
+}
+
+void SoftPwm::run() {
+  pollfd fds[2] {};
+  fds[0].fd = m_timer_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = m_wakeup_fd;
+  fds[1].events = POLLIN;
+
+  while (!m_stop) {
+
+    // Channels which were enabled since the last iteration start their first
+    // period immediately
+    std::int64_t now = monotonicNs();
+    for (std::size_t i = 0; i < m_states.size(); ++i) {
+      if (!m_states[i].active && m_frequencies[i].load() > 0) {
+        m_states[i].active = true;
+        m_states[i].off_edge_next = false;
+        m_states[i].next_edge = now;
+      }
+    }
+
+    std::int64_t deadline = std::numeric_limits<std::int64_t>::max();
+    for (auto& state : m_states) {
+      if (state.active) {
+        deadline = std::min(deadline, state.next_edge);
+      }
+    }
+    if (deadline == std::numeric_limits<std::int64_t>::max()) {
+      disarmTimer(m_timer_fd);
+    } else {
+      armTimer(m_timer_fd, deadline);
+    }
+
+    if (poll(fds, 2, -1) < 0) {
+      continue;
+    }
+    std::uint64_t count;
+    if (fds[1].revents & POLLIN) {
+      read(m_wakeup_fd, &count, sizeof(count));
+    }
+    if (!(fds[0].revents & POLLIN) || read(m_timer_fd, &count, sizeof(count)) < 0) {
+      // Woken up for a change of the settings, so we recompute the deadline
+      continue;
+    }
+
+    now = monotonicNs();
+    std::int64_t latency = now - deadline;
+    m_wakeups.fetch_add(1, std::memory_order_relaxed);
+    m_last_latency.store(latency, std::memory_order_relaxed);
+    m_total_latency.fetch_add(latency, std::memory_order_relaxed);
+    if (latency > m_max_latency.load(std::memory_order_relaxed)) {
+      m_max_latency.store(latency, std::memory_order_relaxed);
+    }
+
+    // All the edges within the merge window are written together. We process
+    // only one edge per channel, so very short pulses are not swallowed.
+    std::uint64_t mask = 0;
+    std::uint64_t values = 0;
+    for (std::size_t i = 0; i < m_states.size(); ++i) {
+      if (m_states[i].active && m_states[i].next_edge <= deadline + m_merge_window_ns) {
+        processEdge(i, now, mask, values);
+      }
+    }
+    if (mask != 0) {
+      try {
+        m_bank.writeMask(mask, values);
+        m_writes.fetch_add(1, std::memory_order_relaxed);
+      } catch (...) {
+        // A failed write must not stop the generator, the next edge will try
+        // again
+      }
+    }
+  }
+}
+
+} // end of namespace RPiHWCtrl
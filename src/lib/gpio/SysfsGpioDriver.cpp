@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file SysfsGpioDriver.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <chrono> // for std::chrono_literals
+#include <thread> // for std::this_thread
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/SysfsGpioDriver.h>
+
+// We introduce the symbols from std::chrono_literals so we can write time
+// like 500ms (500 milliseconds)
+using namespace std::chrono_literals;
+
+namespace RPiHWCtrl {
+
+namespace {
+
+// The maximum time we wait for an exported GPIO to become ready and the
+// maximum delay between two checks
+constexpr auto ready_timeout = 1s;
+constexpr auto max_ready_delay = 2ms;
+
+// Writes the given string to a sysfs file
+void writeFile(const std::string& path, const std::string& content) {
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw GpioException() << "Failed to open " << path << ": " << std::strerror(errno);
+  }
+  auto written = write(fd, content.c_str(), content.size());
+  int err = errno;
+  close(fd);
+  if (written != static_cast<ssize_t>(content.size())) {
+    throw GpioException() << "Failed to write " << path << ": " << std::strerror(err);
+  }
+}
+
+class SysfsGpioLines : public GpioLines {
+
+public:
+
+  SysfsGpioLines(const std::string& sysfs_root, bool adopt_exported,
+                 const std::vector<int>& gpios, GpioDirection direction)
+          : m_sysfs_root(sysfs_root) {
+    // We perform each step for all the GPIOs before we continue with the next
+    // one, so we wait for the driver to initialize all the GPIOs at once. If
+    // we fail we release the GPIOs we already exported before we rethrow the
+    // exception.
+    try {
+      for (auto gpio_no : gpios) {
+        exportGpio(gpio_no, adopt_exported);
+      }
+      for (auto gpio_no : gpios) {
+        waitUntilReady(gpio_no);
+      }
+      for (auto gpio_no : gpios) {
+        configureGpio(gpio_no, direction);
+      }
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  virtual ~SysfsGpioLines() {
+    release();
+  }
+
+  std::size_t size() const override {
+    return m_gpios.size();
+  }
+
+  std::uint64_t readValues(std::uint64_t mask) override {
+    std::uint64_t values = 0;
+    for (std::size_t i = 0; i < m_gpios.size(); ++i) {
+      if (mask & (std::uint64_t{1} << i)) {
+        // We always read from the beginning of the file, so we do not need to seek
+        char value;
+        if (pread(m_value_fds[i], &value, 1, 0) != 1) {
+          throw GpioException() << "Failed to read the value of GPIO " << m_gpios[i];
+        }
+        if (value != '0') {
+          values |= std::uint64_t{1} << i;
+        }
+      }
+    }
+    return values;
+  }
+
+  void writeValues(std::uint64_t mask, std::uint64_t values) override {
+    for (std::size_t i = 0; i < m_gpios.size(); ++i) {
+      if (mask & (std::uint64_t{1} << i)) {
+        const char ch = (values & (std::uint64_t{1} << i)) ? '1' : '0';
+        if (pwrite(m_value_fds[i], &ch, 1, 0) != 1) {
+          throw GpioException() << "Failed to write the value of GPIO " << m_gpios[i];
+        }
+      }
+    }
+  }
+
+  int eventFd() const override {
+    // The edge events are signaled via the value file, so we can only support
+    // them when we handle a single line
+    return (m_value_fds.size() == 1) ? m_value_fds[0] : -1;
+  }
+
+  short eventPollFlags() const override {
+    return POLLPRI;
+  }
+
+  std::size_t readEvents(EdgeEvent* events, std::size_t) override {
+    // The sysfs interface does not report the events themselves, so we create
+    // one from the current value. Reading the value file rearms the
+    // notification. The sequence number only counts the events we read, so
+    // edges lost between two notifications cannot be detected.
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bool value = readValues(1) != 0;
+    events[0].type = value ? EdgeEvent::Type::RISING : EdgeEvent::Type::FALLING;
+    events[0].timestamp_ns = std::uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    events[0].seqno = ++m_seqno;
+    events[0].line = 0;
+    return 1;
+  }
+
+  void clearEvents() override {
+    readValues(1);
+  }
+
+private:
+
+  std::string gpioDir(int gpio_no) const {
+    return m_sysfs_root + "/gpio" + std::to_string(gpio_no);
+  }
+
+  void exportGpio(int gpio_no, bool adopt_exported) {
+    // Check that the GPIO is not already exported. If it is, we use it as it
+    // is if we are allowed to, and we do not unexport it when we are done.
+    m_gpios.push_back(gpio_no);
+    if (access(gpioDir(gpio_no).c_str(), F_OK) == 0) {
+      if (!adopt_exported) {
+        m_gpios.pop_back();
+        throw GpioAlreadyReserved(gpio_no);
+      }
+      return;
+    }
+
+    // Export the GPIO by writing its number to the export file
+    writeFile(m_sysfs_root + "/export", std::to_string(gpio_no));
+    m_exported.push_back(gpio_no);
+  }
+
+  void waitUntilReady(int gpio_no) {
+    // After the GPIO directory appears, udev still needs to set the
+    // permissions of its files, so we wait until we can write the direction
+    // file. We retry with an increasing delay, so we do not wait more than
+    // necessary, up to a bound.
+    std::string direction_file = gpioDir(gpio_no) + "/direction";
+    auto delay = 50us;
+    auto waited = 0us;
+    while (access(direction_file.c_str(), W_OK) != 0) {
+      if (waited >= ready_timeout) {
+        throw GpioException() << "Failed to export GPIO " << gpio_no;
+      }
+      std::this_thread::sleep_for(delay);
+      waited += delay;
+      delay = std::min<std::chrono::microseconds>(delay * 2, max_ready_delay);
+    }
+  }
+
+  void configureGpio(int gpio_no, GpioDirection direction) {
+    std::string gpio_dir = gpioDir(gpio_no);
+
+    // Set the direction of the GPIO by writing to the direction file
+    writeFile(gpio_dir + "/direction", direction == GpioDirection::INPUT ? "in" : "out");
+
+    // For inputs set that both rising and falling edges will generate
+    // interrupts, which will make the poll() method to return
+    if (direction == GpioDirection::INPUT) {
+      writeFile(gpio_dir + "/edge", "both");
+    }
+
+    // Open the value file. We keep the descriptor open so reading and writing
+    // the value does not need to open the file each time.
+    std::string value_file = gpio_dir + "/value";
+    int value_fd = open(value_file.c_str(),
+                        (direction == GpioDirection::INPUT ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+    if (value_fd < 0) {
+      throw GpioException() << "Failed to open the value file of GPIO " << gpio_no;
+    }
+    m_value_fds.push_back(value_fd);
+  }
+
+  void release() {
+    for (auto fd : m_value_fds) {
+      close(fd);
+    }
+    m_value_fds.clear();
+
+    // Unexport the GPIOs we exported by writing their numbers to the unexport
+    // file. We ignore any errors, as there is nothing we can do about them.
+    for (auto gpio_no : m_exported) {
+      try {
+        writeFile(m_sysfs_root + "/unexport", std::to_string(gpio_no));
+      } catch (const GpioException&) {
+      }
+    }
+    m_exported.clear();
+    m_gpios.clear();
+  }
+
+  std::string m_sysfs_root;
+  std::vector<int> m_gpios {};
+  std::vector<int> m_exported {};
+  std::vector<int> m_value_fds {};
+  std::uint32_t m_seqno = 0;
+
+};
+
+} // end of anonymous namespace
+
+constexpr const char* SysfsGpioDriver::default_sysfs_root;
+
+std::shared_ptr<SysfsGpioDriver> SysfsGpioDriver::getDefault() {
+  static std::shared_ptr<SysfsGpioDriver> driver = std::make_shared<SysfsGpioDriver>();
+  return driver;
+}
+
+SysfsGpioDriver::SysfsGpioDriver(const std::string& sysfs_root, bool adopt_exported)
+        : m_sysfs_root(sysfs_root), m_adopt_exported(adopt_exported) {
+}
+
+std::unique_ptr<GpioLines> SysfsGpioDriver::requestLines(const std::vector<int>& gpios,
+                                                         GpioDirection direction) {
+  if (gpios.size() > 64) {
+    throw GpioException() << "Cannot request more than 64 GPIO lines at once";
+  }
+  return std::make_unique<SysfsGpioLines>(m_sysfs_root, m_adopt_exported, gpios, direction);
+}
+
+} // end of namespace RPiHWCtrl
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file WaveformSequencer.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <time.h>
+#include <cerrno>
+#include <algorithm>
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/gpio/WaveformSequencer.h>
+
+namespace RPiHWCtrl {
+
+namespace {
+
+constexpr std::int64_t ns_per_s = 1000000000;
+
+// The longest time we sleep before checking if we have to stop, so stop()
+// does not have to wait for long gaps between the steps
+constexpr std::int64_t max_sleep_ns = 50000000;
+
+std::int64_t monotonicNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return std::int64_t{now.tv_sec} * ns_per_s + now.tv_nsec;
+}
+
+} // end of anonymous namespace
+
+WaveformSequencer::WaveformSequencer(GpioBank& bank, std::chrono::nanoseconds late_threshold)
+        : m_bank(bank), m_late_threshold_ns(late_threshold.count()) {
+}
+
+WaveformSequencer::~WaveformSequencer() {
+  stop();
+}
+
+void WaveformSequencer::play(const Waveform& waveform, bool loop) {
+  if (loop && waveform.period().count() <= 0) {
+    throw GpioException() << "Cannot loop a waveform with zero period";
+  }
+  if (m_playing.exchange(true)) {
+    throw GpioException() << "A waveform is already playing";
+  }
+  m_stop = false;
+  try {
+    run(waveform, loop);
+  } catch (...) {
+    m_playing = false;
+    throw;
+  }
+  m_playing = false;
+}
+
+void WaveformSequencer::start(Waveform waveform, bool loop) {
+  if (loop && waveform.period().count() <= 0) {
+    throw GpioException() << "Cannot loop a waveform with zero period";
+  }
+  if (m_playing.exchange(true)) {
+    throw GpioException() << "A waveform is already playing";
+  }
+  // Join the thread of a previous waveform which finished by itself
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+  m_stop = false;
+  m_thread = std::thread {[this, waveform, loop]() {
+    try {
+      run(waveform, loop);
+    } catch (...) {
+      // There is nobody to report the error to, so we just stop playing
+    }
+    m_playing = false;
+  }};
+}
+
+void WaveformSequencer::stop() {
+  m_stop = true;
+  wait();
+}
+
+void WaveformSequencer::wait() {
+  if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id()) {
+    m_thread.join();
+  }
+}
+
+WaveformSequencer::Stats WaveformSequencer::stats() const {
+  Stats result;
+  result.steps = m_steps.load(std::memory_order_relaxed);
+  result.late_steps = m_late_steps.load(std::memory_order_relaxed);
+  result.repetitions = m_repetitions.load(std::memory_order_relaxed);
+  result.max_lateness_ns = m_max_lateness.load(std::memory_order_relaxed);
+  result.mean_lateness_ns = (result.steps == 0) ? 0
+          : m_total_lateness.load(std::memory_order_relaxed) / std::int64_t(result.steps);
+  return result;
+}
+
+bool WaveformSequencer::sleepUntil(std::int64_t deadline_ns) {
+  for (;;) {
+    if (m_stop) {
+      return false;
+    }
+    std::int64_t now = monotonicNs();
+    if (now >= deadline_ns) {
+      return true;
+    }
+    std::int64_t wake_up = std::min(deadline_ns, now + max_sleep_ns);
+    timespec ts;
+    ts.tv_sec = wake_up / ns_per_s;
+    ts.tv_nsec = wake_up % ns_per_s;
+    // With an absolute time an interrupted sleep is simply repeated
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+  }
+}
+
+void WaveformSequencer::run(const Waveform& waveform, bool loop) {
+  const auto& steps = waveform.steps();
+  const std::int64_t period = waveform.period().count();
+
+  // All the steps are scheduled relative to the start, so any delay of a step
+  // does not shift the ones which follow
+  std::int64_t start = monotonicNs();
+  do {
+    for (auto& step : steps) {
+      std::int64_t deadline = start + step.offset.count();
+      if (!sleepUntil(deadline)) {
+        return;
+      }
+      m_bank.writeMask(step.mask, step.values);
+
+      std::int64_t lateness = monotonicNs() - deadline;
+      m_steps.fetch_add(1, std::memory_order_relaxed);
+      m_total_lateness.fetch_add(lateness, std::memory_order_relaxed);
+      if (lateness > m_late_threshold_ns) {
+        m_late_steps.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (lateness > m_max_lateness.load(std::memory_order_relaxed)) {
+        m_max_lateness.store(lateness, std::memory_order_relaxed);
+      }
+    }
+    if (loop && !sleepUntil(start + period)) {
+      return;
+    }
+    start += period;
+    m_repetitions.fetch_add(1, std::memory_order_relaxed);
+  } while (loop && !m_stop);
+}
+
+} // end of namespace RPiHWCtrl
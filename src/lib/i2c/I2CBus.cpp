@@ -20,10 +20,13 @@
  * @author nikoapos
  */
 
+#include <map>
+#include <mutex>
 #include <string>
 #include <fcntl.h> // For open()
 #include <unistd.h> // For close()
 #include <sys/ioctl.h> // For ioctl()
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <RPiHWCtrl/i2c/I2CBus.h>
 #include <RPiHWCtrl/Interfaces/exceptions.h>
@@ -32,29 +35,46 @@ namespace RPiHWCtrl {
 
 namespace {
 
-constexpr int I2C_ADAPTER = 1;
 constexpr int SDA_GPIO = 2;
 constexpr int SCL_GPIO = 3;
 
-void connectToDevice(int bus_file, int address) {
-  if (ioctl(bus_file, I2C_SLAVE, address) < 0) {
-    throw I2CDeviceConnectionFailure(address);
-  }
-}
-
 } // end of anonymous namespace
 
+constexpr int I2CBus::default_adapter;
+
 std::shared_ptr<I2CBus> I2CBus::getSingleton() {
-  static std::shared_ptr<I2CBus> singleton = std::shared_ptr<I2CBus>(new I2CBus{});
+  static std::shared_ptr<I2CBus> singleton = getBus(default_adapter);
   return singleton;
 }
 
-I2CBus::I2CBus() {
+std::shared_ptr<I2CBus> I2CBus::getBus(int adapter) {
+  // We keep only weak pointers, so the device of an adapter is closed when
+  // nobody uses it any more
+  static std::mutex registry_mutex;
+  static std::map<int, std::weak_ptr<I2CBus>> registry;
+  
+  std::lock_guard<std::mutex> lock {registry_mutex};
+  auto bus = registry[adapter].lock();
+  if (!bus) {
+    bus = std::make_shared<I2CBus>("/dev/i2c-" + std::to_string(adapter));
+    registry[adapter] = bus;
+  }
+  return bus;
+}
+
+I2CBus::I2CBus(const std::string& device_path) : m_device_path(device_path) {
   // Open the file for using the bus
-  std::string filename = "/dev/i2c-" + std::to_string(I2C_ADAPTER);
-  m_bus_file = open(filename.c_str(), O_RDWR);
+  m_bus_file = open(m_device_path.c_str(), O_RDWR | O_CLOEXEC);
   if (m_bus_file < 0) {
-    throw I2CBusOpenFailure(filename);
+    throw I2CBusOpenFailure(m_device_path);
+  }
+  
+  // Check if the adapter can send a write and a read message with a repeated
+  // start between them. SMBus-only adapters cannot, so for them we fall back
+  // to a separate write() and read().
+  unsigned long functionality = 0;
+  if (ioctl(m_bus_file, I2C_FUNCS, &functionality) == 0) {
+    m_combined_transfers = (functionality & I2C_FUNC_I2C) != 0;
   }
 }
 
@@ -64,10 +84,50 @@ I2CBus::~I2CBus() {
   close(m_bus_file);
 }
 
-I2CTransaction I2CBus::startTransaction(std::uint8_t address) {
-  I2CTransaction transaction {m_bus_mutex};
-  connectToDevice(m_bus_file, address);
+I2CTransaction I2CBus::startTransaction(std::uint8_t address, bool force) {
+  I2CTransaction transaction {m_bus_mutex, m_owner, m_bus_file, address,
+                              m_combined_transfers, m_retry_policy};
+  m_address = address;
+  if (!m_combined_transfers) {
+    selectAddress(address, force);
+  } else if (!force) {
+    checkAddress(address);
+  }
   return transaction;
 }
 
+void I2CBus::setRetryPolicy(const I2CRetryPolicy& retry_policy) {
+  std::lock_guard<std::mutex> lock {m_bus_mutex};
+  m_retry_policy = retry_policy;
+}
+
+I2CRetryPolicy I2CBus::retryPolicy() const {
+  std::lock_guard<std::mutex> lock {m_bus_mutex};
+  return m_retry_policy;
+}
+
+void I2CBus::selectAddress(std::uint8_t address, bool force) {
+  // Polling the same device is the common case, so we skip the ioctl when the
+  // file already points to the address
+  if (address == m_selected_address && force == m_selected_force) {
+    return;
+  }
+  if (ioctl(m_bus_file, force ? I2C_SLAVE_FORCE : I2C_SLAVE, address) < 0) {
+    m_selected_address = -1;
+    throw I2CDeviceConnectionFailure(address);
+  }
+  m_selected_address = address;
+  m_selected_force = force;
+}
+
+void I2CBus::checkAddress(std::uint8_t address) {
+  // The I2C_RDWR ioctl does not check if a kernel driver uses the device, so
+  // we let the I2C_SLAVE ioctl check it, once per address
+  if (address < m_checked_addresses.size() && m_checked_addresses.test(address)) {
+    return;
+  }
+  selectAddress(address, false);
+  m_checked_addresses.set(address);
+}
+
 } // end of namespace RPiHWCtrl
\ No newline at end of file
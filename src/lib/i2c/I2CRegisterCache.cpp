@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file i2c/I2CRegisterCache.cpp
+ * @author nikoapos
+ */
+
+#include <algorithm>
+#include <RPiHWCtrl/i2c/I2CRegisterCache.h>
+#include <RPiHWCtrl/Interfaces/exceptions.h>
+
+namespace RPiHWCtrl {
+
+constexpr std::size_t I2CRegisterCache::register_count;
+
+I2CRegisterCache::I2CRegisterCache(std::shared_ptr<I2CBus> bus, std::uint8_t address,
+                                   WritePolicy policy)
+        : m_bus(std::move(bus)), m_address(address), m_policy(policy) {
+}
+
+I2CRegisterCache::~I2CRegisterCache() {
+  try {
+    sync();
+  } catch (...) {
+    // Destructors must not throw, and there is nothing else we can do
+  }
+}
+
+void I2CRegisterCache::setCacheable(std::uint8_t first, std::uint8_t last, bool cacheable) {
+  std::lock_guard<std::mutex> lock {m_mutex};
+  for (std::size_t i = first; i <= last; ++i) {
+    m_cacheable[i] = cacheable;
+    if (!cacheable) {
+      m_valid[i] = false;
+      m_dirty[i] = false;
+    }
+  }
+}
+
+std::uint8_t I2CRegisterCache::read(std::uint8_t register_address) {
+  std::uint8_t value;
+  read(register_address, &value, 1);
+  return value;
+}
+
+void I2CRegisterCache::read(std::uint8_t register_address, std::uint8_t* buffer,
+                            std::size_t size) {
+  checkRange(register_address, size);
+  std::lock_guard<std::mutex> lock {m_mutex};
+  readLocked(register_address, buffer, size);
+}
+
+void I2CRegisterCache::readLocked(std::uint8_t register_address, std::uint8_t* buffer,
+                                  std::size_t size) {
+  if (allSet(m_valid, register_address, size)) {
+    std::copy_n(m_values.begin() + register_address, size, buffer);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  m_misses.fetch_add(1, std::memory_order_relaxed);
+  {
+    auto transaction = m_bus->startTransaction(m_address);
+    transaction.queueRead(register_address, buffer, size);
+    transaction.submit();
+  }
+
+  // The values of dirty registers have not reached the device yet, so the
+  // cached ones are the correct ones
+  for (std::size_t i = 0; i < size; ++i) {
+    std::size_t reg = register_address + i;
+    if (m_dirty[reg]) {
+      buffer[i] = m_values[reg];
+    } else if (m_cacheable[reg]) {
+      m_values[reg] = buffer[i];
+      m_valid[reg] = true;
+    }
+  }
+}
+
+void I2CRegisterCache::write(std::uint8_t register_address, std::uint8_t value) {
+  write(register_address, &value, 1);
+}
+
+void I2CRegisterCache::write(std::uint8_t register_address, const std::uint8_t* data,
+                             std::size_t size) {
+  checkRange(register_address, size);
+  std::lock_guard<std::mutex> lock {m_mutex};
+  writeLocked(register_address, data, size);
+}
+
+void I2CRegisterCache::writeLocked(std::uint8_t register_address, const std::uint8_t* data,
+                                   std::size_t size) {
+  bool write_back = m_policy == WritePolicy::WRITE_BACK
+                    && allSet(m_cacheable, register_address, size);
+  if (!write_back) {
+    auto transaction = m_bus->startTransaction(m_address);
+    transaction.queueWrite(register_address, data, size);
+    transaction.submit();
+  }
+
+  for (std::size_t i = 0; i < size; ++i) {
+    std::size_t reg = register_address + i;
+    if (m_cacheable[reg]) {
+      m_values[reg] = data[i];
+      m_valid[reg] = true;
+      m_dirty[reg] = write_back;
+    }
+  }
+}
+
+void I2CRegisterCache::update(std::uint8_t register_address, std::uint8_t mask,
+                              std::uint8_t value) {
+  std::lock_guard<std::mutex> lock {m_mutex};
+  std::uint8_t current;
+  readLocked(register_address, &current, 1);
+  std::uint8_t updated = (current & ~mask) | (value & mask);
+  // A cached register which does not change does not need to be written
+  if (updated != current || !m_cacheable[register_address]) {
+    writeLocked(register_address, &updated, 1);
+  }
+}
+
+void I2CRegisterCache::sync() {
+  std::lock_guard<std::mutex> lock {m_mutex};
+  syncLocked();
+}
+
+void I2CRegisterCache::syncLocked() {
+  if (m_dirty.none()) {
+    return;
+  }
+  auto transaction = m_bus->startTransaction(m_address);
+  std::size_t reg = 0;
+  while (reg < register_count) {
+    if (!m_dirty[reg]) {
+      ++reg;
+      continue;
+    }
+    std::size_t first = reg;
+    while (reg < register_count && m_dirty[reg]) {
+      ++reg;
+    }
+    transaction.queueWrite(static_cast<std::uint8_t>(first), m_values.data() + first, reg - first);
+  }
+  transaction.submit();
+  m_dirty.reset();
+}
+
+void I2CRegisterCache::invalidate() {
+  std::lock_guard<std::mutex> lock {m_mutex};
+  m_valid.reset();
+  m_dirty.reset();
+}
+
+std::size_t I2CRegisterCache::dirtyCount() const {
+  std::lock_guard<std::mutex> lock {m_mutex};
+  return m_dirty.count();
+}
+
+bool I2CRegisterCache::allSet(const std::bitset<register_count>& bits, std::size_t first,
+                              std::size_t size) const {
+  for (std::size_t i = first; i < first + size; ++i) {
+    if (!bits[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void I2CRegisterCache::checkRange(std::uint8_t register_address, std::size_t size) const {
+  if (size == 0 || register_address + size > register_count) {
+    throw I2CException() << "Invalid register range " << int(register_address)
+                         << "+" << size;
+  }
+}
+
+} // end of namespace RPiHWCtrl
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file i2c/I2CRequestQueue.cpp
+ * @author nikoapos
+ */
+
+#include <algorithm>
+#include <RPiHWCtrl/i2c/I2CRequestQueue.h>
+#include <RPiHWCtrl/Interfaces/exceptions.h>
+
+namespace RPiHWCtrl {
+
+constexpr std::size_t I2CRequestQueue::priority_classes;
+
+I2CRequestQueue::I2CRequestQueue(std::shared_ptr<I2CBus> bus, std::size_t max_batch)
+        : m_bus(std::move(bus)), m_max_batch(std::max<std::size_t>(max_batch, 1)) {
+  m_thread = std::thread {&I2CRequestQueue::run, this};
+}
+
+I2CRequestQueue::~I2CRequestQueue() {
+  {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    m_stopping = true;
+  }
+  m_pending.notify_all();
+  m_thread.join();
+
+  // Fail all the requests which never started, so nobody waits for them
+  auto error = std::make_exception_ptr(I2CException() << "The I2C request queue was destroyed");
+  for (auto& queue : m_queues) {
+    for (auto& request : queue) {
+      request.callback(error);
+    }
+  }
+}
+
+void I2CRequestQueue::submit(std::uint8_t address, std::function<void(I2CTransaction&)> prepare,
+                             Callback callback, Priority priority) {
+  std::size_t index = static_cast<std::size_t>(priority);
+  {
+    std::lock_guard<std::mutex> lock {m_mutex};
+    auto& queue = m_queues[index];
+    queue.push_back(Request {address, std::move(prepare), std::move(callback), Clock::now()});
+    m_counters[index].max_depth = std::max(m_counters[index].max_depth, queue.size());
+  }
+  m_pending.notify_one();
+}
+
+std::future<void> I2CRequestQueue::submit(std::uint8_t address,
+                                          std::function<void(I2CTransaction&)> prepare,
+                                          Priority priority) {
+  auto promise = std::make_shared<std::promise<void>>();
+  auto future = promise->get_future();
+  submit(address, std::move(prepare), [promise](std::exception_ptr error) {
+    if (error) {
+      promise->set_exception(error);
+    } else {
+      promise->set_value();
+    }
+  }, priority);
+  return future;
+}
+
+std::future<std::vector<std::uint8_t>> I2CRequestQueue::readRegisters(std::uint8_t address,
+        std::uint8_t register_address, std::size_t size, Priority priority) {
+  // The buffer must live until the transaction is submitted, so it is owned by
+  // the callback and moved in the promise at the end
+  auto buffer = std::make_shared<std::vector<std::uint8_t>>(size);
+  auto promise = std::make_shared<std::promise<std::vector<std::uint8_t>>>();
+  auto future = promise->get_future();
+  submit(address, [buffer, register_address](I2CTransaction& transaction) {
+    transaction.queueRead(register_address, buffer->data(), buffer->size());
+  }, [buffer, promise](std::exception_ptr error) {
+    if (error) {
+      promise->set_exception(error);
+    } else {
+      promise->set_value(std::move(*buffer));
+    }
+  }, priority);
+  return future;
+}
+
+std::future<void> I2CRequestQueue::writeRegisters(std::uint8_t address,
+        std::uint8_t register_address, std::vector<std::uint8_t> data, Priority priority) {
+  auto shared_data = std::make_shared<std::vector<std::uint8_t>>(std::move(data));
+  return submit(address, [shared_data, register_address](I2CTransaction& transaction) {
+    transaction.queueWrite(register_address, shared_data->data(), shared_data->size());
+  }, priority);
+}
+
+I2CRequestQueue::ClassMetrics I2CRequestQueue::metrics(Priority priority) const {
+  std::size_t index = static_cast<std::size_t>(priority);
+  std::lock_guard<std::mutex> lock {m_mutex};
+  auto& counters = m_counters[index];
+  ClassMetrics result;
+  result.queue_depth = m_queues[index].size();
+  result.max_queue_depth = counters.max_depth;
+  result.completed = counters.completed;
+  result.mean_wait = (counters.started == 0) ? std::chrono::nanoseconds {0}
+                                             : counters.total_wait / std::int64_t(counters.started);
+  result.max_wait = counters.max_wait;
+  return result;
+}
+
+I2CRequestQueue::Request I2CRequestQueue::popRequest(std::size_t index) {
+  auto& queue = m_queues[index];
+  auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - queue.front().enqueued);
+  auto& counters = m_counters[index];
+  ++counters.started;
+  counters.total_wait += wait;
+  counters.max_wait = std::max(counters.max_wait, wait);
+  Request request = std::move(queue.front());
+  queue.pop_front();
+  return request;
+}
+
+bool I2CRequestQueue::higherPending(std::size_t index) const {
+  for (std::size_t i = 0; i < index; ++i) {
+    if (!m_queues[i].empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void I2CRequestQueue::run() {
+  for (;;) {
+    std::vector<Request> batch;
+    batch.reserve(m_max_batch);
+    std::size_t index = 0;
+    {
+      std::unique_lock<std::mutex> lock {m_mutex};
+      m_pending.wait(lock, [this]() {
+        return m_stopping || !m_queues[0].empty() || !m_queues[1].empty() || !m_queues[2].empty();
+      });
+      if (m_stopping) {
+        return;
+      }
+      while (m_queues[index].empty()) {
+        ++index;
+      }
+      batch.push_back(popRequest(index));
+    }
+    std::uint8_t address = batch.front().address;
+
+    // All the requests of the batch share the same transaction, but each of
+    // them is submitted separately, so a failure is reported only to the
+    // request it belongs to. The operations of a request which fails while it
+    // is prepared are discarded, so they do not reach the device.
+    std::vector<std::exception_ptr> errors;
+    errors.reserve(m_max_batch);
+    try {
+      auto transaction = m_bus->startTransaction(address);
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        try {
+          batch[i].prepare(transaction);
+          transaction.submit();
+          errors.emplace_back();
+        } catch (...) {
+          transaction.discard();
+          errors.push_back(std::current_exception());
+        }
+
+        // We continue with the next request of the same class if it goes to
+        // the same device. The check is repeated after every request, so a
+        // request of a higher class stops the batch as soon as it arrives.
+        if (batch.size() < m_max_batch) {
+          std::lock_guard<std::mutex> lock {m_mutex};
+          auto& queue = m_queues[index];
+          if (!m_stopping && !higherPending(index) && !queue.empty()
+              && queue.front().address == address) {
+            batch.push_back(popRequest(index));
+          }
+        }
+      }
+    } catch (...) {
+      // The transaction itself failed, so none of the requests was executed
+      errors.assign(batch.size(), std::current_exception());
+    }
+
+    // The callbacks are called after the transaction ends, so they can use the
+    // bus. The requests are counted before, so the statistics already include
+    // a request when its future becomes ready.
+    {
+      std::lock_guard<std::mutex> lock {m_mutex};
+      m_counters[index].completed += batch.size();
+    }
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      try {
+        batch[i].callback(errors[i]);
+      } catch (...) {
+        // An exception from a callback must not stop the worker
+      }
+    }
+  }
+}
+
+} // end of namespace RPiHWCtrl
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2017 nikoapos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* 
+ * @file i2c/I2CTransaction.cpp
+ * @author nikoapos
+ */
+
+#include <unistd.h> // For read() and write()
+#include <sys/ioctl.h> // For ioctl()
+#include <cerrno>
+#include <algorithm>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <RPiHWCtrl/i2c/I2CTransaction.h>
+#include <RPiHWCtrl/Interfaces/exceptions.h>
+
+namespace RPiHWCtrl {
+
+namespace {
+
+// The maximum length of a single I2C message accepted by the i2c-dev driver.
+// The length field of the messages is 16 bits, but the driver rejects anything
+// longer than this.
+constexpr std::size_t max_message_size = 8192;
+
+// Returns zero if a system call transferred the expected number of bytes or
+// messages, and the error otherwise. Short transfers do not set the errno, so
+// they are reported as I/O errors instead of using a stale errno.
+int transferError(ssize_t result, std::size_t expected) {
+  if (result == static_cast<ssize_t>(expected)) {
+    return 0;
+  }
+  return result < 0 ? errno : EIO;
+}
+
+} // end of anonymous namespace
+
+I2CTransaction& I2CTransaction::queueRead(std::uint8_t register_address,
+                                          std::uint8_t* buffer, std::size_t size) {
+  if (size == 0 || size > max_message_size) {
+    throw I2CException() << "Invalid I2C read size " << size;
+  }
+  m_operations.push_back(Operation {buffer, m_write_data.size(), size, false, 0, 0});
+  m_write_data.push_back(register_address);
+  return *this;
+}
+
+I2CTransaction& I2CTransaction::queueWrite(std::uint8_t register_address,
+                                           const std::uint8_t* data, std::size_t size) {
+  if (size == 0 || size + 1 > max_message_size) {
+    throw I2CException() << "Invalid I2C write size " << size;
+  }
+  m_operations.push_back(Operation {nullptr, m_write_data.size(), size, false, 0, 0});
+  m_write_data.push_back(register_address);
+  m_write_data.insert(m_write_data.end(), data, data + size);
+  return *this;
+}
+
+I2CTransaction& I2CTransaction::deferWrite(std::uint8_t register_address,
+                                           const std::uint8_t* data, std::size_t size) {
+  // If the previous operation is a deferred write which ends just before this
+  // register, we extend it instead of adding a new message
+  if (!m_operations.empty()) {
+    auto& last = m_operations.back();
+    std::size_t last_end = m_write_data[last.data_offset] + last.size;
+    if (last.deferred && last_end == register_address
+        && last.size + size + 1 <= max_message_size) {
+      m_write_data.insert(m_write_data.end(), data, data + size);
+      last.size += size;
+      m_merged_sizes.push_back(size);
+      ++last.part_count;
+      return *this;
+    }
+  }
+  queueWrite(register_address, data, size);
+  auto& op = m_operations.back();
+  op.deferred = true;
+  op.first_part = m_merged_sizes.size();
+  op.part_count = 1;
+  m_merged_sizes.push_back(size);
+  m_deferred_writes = true;
+  return *this;
+}
+
+void I2CTransaction::commit() {
+  submit();
+}
+
+void I2CTransaction::discard() {
+  m_operations.clear();
+  m_write_data.clear();
+  m_merged_sizes.clear();
+  m_deferred_writes = false;
+}
+
+void I2CTransaction::flushDeferredWrites() {
+  // The data of the removed operations stay in the m_write_data, so the
+  // offsets of the deferred writes do not change
+  m_operations.erase(std::remove_if(m_operations.begin(), m_operations.end(),
+                                    [](const Operation& op) { return !op.deferred; }),
+                     m_operations.end());
+  submit();
+}
+
+void I2CTransaction::isolateMergedWrite(const Operation& op,
+                                        const std::vector<std::uint8_t>& write_data,
+                                        const std::vector<std::size_t>& merged_sizes,
+                                        std::size_t operations, int err_code) {
+  // Each part becomes again a write of its own, starting from its register
+  std::uint8_t register_address = write_data[op.data_offset];
+  const std::uint8_t* data = write_data.data() + op.data_offset + 1;
+  std::vector<std::uint8_t> message;
+  for (std::size_t i = op.first_part; i < op.first_part + op.part_count; ++i) {
+    message.assign(1, register_address);
+    message.insert(message.end(), data, data + merged_sizes[i]);
+    auto status = writeMessage(m_bus_file, m_address, m_combined_transfers, m_retry_policy,
+                               message.data(), message.size());
+    if (!status) {
+      throw I2CTransferException(operations, register_address, true, status.err_code);
+    }
+    register_address = static_cast<std::uint8_t>(register_address + merged_sizes[i]);
+    data += merged_sizes[i];
+  }
+  // All the parts succeeded on their own, so we report the whole burst
+  throw I2CTransferException(operations, write_data[op.data_offset], true, err_code);
+}
+
+void I2CTransaction::submit() {
+  if (m_operations.empty()) {
+    return;
+  }
+  
+  // The queue is emptied before anything is sent, so it is empty even if the
+  // transfer fails
+  std::vector<Operation> queue;
+  std::vector<std::uint8_t> write_data;
+  std::vector<std::size_t> merged_sizes;
+  queue.swap(m_operations);
+  write_data.swap(m_write_data);
+  merged_sizes.swap(m_merged_sizes);
+  m_deferred_writes = false;
+  
+  if (!m_combined_transfers) {
+    submitSeparately(queue, write_data, merged_sizes);
+    return;
+  }
+  
+  // Each read needs two messages, one for writing the register address and
+  // one for reading the data, and each write needs one. We keep the operation
+  // of each message, for reporting errors.
+  std::vector<i2c_msg> messages;
+  std::vector<std::size_t> message_ops;
+  messages.reserve(2 * queue.size());
+  message_ops.reserve(2 * queue.size());
+  for (std::size_t i = 0; i < queue.size(); ++i) {
+    auto& op = queue[i];
+    i2c_msg message;
+    message.addr = m_address;
+    message.flags = 0;
+    message.len = static_cast<std::uint16_t>(op.read_buffer ? 1 : op.size + 1);
+    message.buf = write_data.data() + op.data_offset;
+    messages.push_back(message);
+    message_ops.push_back(i);
+    if (op.read_buffer) {
+      message.flags = I2C_M_RD;
+      message.len = static_cast<std::uint16_t>(op.size);
+      message.buf = op.read_buffer;
+      messages.push_back(message);
+      message_ops.push_back(i);
+    }
+  }
+  
+  // The kernel limits the number of the messages of a single call, so very
+  // long queues are split, without separating the two messages of a read
+  std::size_t first = 0;
+  while (first < messages.size()) {
+    std::size_t count = std::min<std::size_t>(messages.size() - first, I2C_RDWR_IOCTL_MAX_MSGS);
+    if (first + count < messages.size() && (messages[first + count].flags & I2C_M_RD)) {
+      --count;
+    }
+    i2c_rdwr_ioctl_data data {messages.data() + first, static_cast<std::uint32_t>(count)};
+    int err_code = m_retry_policy.run([&]() {
+      return transferError(ioctl(m_bus_file, I2C_RDWR, &data), count);
+    });
+    if (err_code != 0) {
+      
+      // The kernel does not tell which message failed. Finding it means
+      // sending again the operations before it, which is safe only for the
+      // deferred writes (they set registers to fixed values). Reads might
+      // clear the registers or consume FIFO data, and the immediate writes
+      // might trigger actions, so in that case we report the whole call.
+      bool only_deferred = true;
+      for (std::size_t message = first; message < first + count; ++message) {
+        only_deferred = only_deferred && queue[message_ops[message]].deferred;
+      }
+      if (!only_deferred) {
+        throw I2CTransferException(queue.size(), -1, false, err_code);
+      }
+      
+      // We send the deferred writes of the failed call one by one, until we
+      // find the one which fails
+      std::size_t message = first;
+      while (message < first + count) {
+        auto& op = queue[message_ops[message]];
+        i2c_rdwr_ioctl_data single {messages.data() + message, 1};
+        err_code = m_retry_policy.run([&]() {
+          return transferError(ioctl(m_bus_file, I2C_RDWR, &single), 1);
+        });
+        if (err_code != 0) {
+          if (op.part_count > 1) {
+            isolateMergedWrite(op, write_data, merged_sizes, queue.size(), err_code);
+          }
+          throw I2CTransferException(queue.size(), write_data[op.data_offset], true, err_code);
+        }
+        ++message;
+      }
+    }
+    first += count;
+  }
+}
+
+I2CStatus I2CTransaction::writeMessage(int bus_file, std::uint8_t address,
+                                       bool combined_transfers,
+                                       const I2CRetryPolicy& retry_policy,
+                                       const std::uint8_t* message, std::size_t size) {
+  I2CStatus status;
+  status.register_address = message[0];
+  if (size > max_message_size) {
+    status.err_code = EMSGSIZE;
+    return status;
+  }
+  status.err_code = retry_policy.run([&]() {
+    if (combined_transfers) {
+      i2c_msg i2c_message;
+      i2c_message.addr = address;
+      i2c_message.flags = 0;
+      i2c_message.len = static_cast<std::uint16_t>(size);
+      i2c_message.buf = const_cast<std::uint8_t*>(message);
+      i2c_rdwr_ioctl_data data {&i2c_message, 1};
+      return transferError(ioctl(bus_file, I2C_RDWR, &data), 1);
+    }
+    return transferError(write(bus_file, message, size), size);
+  }, &status.attempts);
+  return status;
+}
+
+I2CStatus I2CTransaction::readRegisterBytes(int bus_file, std::uint8_t address,
+                                            bool combined_transfers,
+                                            const I2CRetryPolicy& retry_policy,
+                                            std::uint8_t register_address,
+                                            std::uint8_t* buffer, std::size_t size) {
+  I2CStatus status;
+  status.register_address = register_address;
+  // Longer reads would be truncated by the 16 bit length of the message, or
+  // rejected by the driver with an unhelpful EINVAL
+  if (size > max_message_size) {
+    status.err_code = EMSGSIZE;
+    return status;
+  }
+  status.err_code = retry_policy.run([&]() {
+    if (combined_transfers) {
+      // Send the register address and read the data in a single transaction,
+      // so there is no STOP between them and we need only one system call
+      i2c_msg messages[2];
+      messages[0].addr = address;
+      messages[0].flags = 0;
+      messages[0].len = 1;
+      messages[0].buf = &register_address;
+      messages[1].addr = address;
+      messages[1].flags = I2C_M_RD;
+      messages[1].len = static_cast<std::uint16_t>(size);
+      messages[1].buf = buffer;
+      i2c_rdwr_ioctl_data data {messages, 2};
+      return transferError(ioctl(bus_file, I2C_RDWR, &data), 2);
+    }
+    
+    // Write to the bus the register we want to read
+    int err_code = transferError(write(bus_file, &register_address, 1), 1);
+    if (err_code != 0) {
+      return err_code;
+    }
+    
+    // Read the register in the buffer
+    return transferError(read(bus_file, buffer, size), size);
+  }, &status.attempts);
+  return status;
+}
+
+void I2CTransaction::submitSeparately(const std::vector<Operation>& queue,
+                                      std::vector<std::uint8_t>& write_data,
+                                      const std::vector<std::size_t>& merged_sizes) {
+  // Without combined transfers we have to use a separate write() and read()
+  // for each operation, as the old register methods of the I2CBus do
+  for (auto& op : queue) {
+    std::uint8_t* data = write_data.data() + op.data_offset;
+    I2CStatus status = op.read_buffer
+        ? readRegisterBytes(m_bus_file, m_address, false, m_retry_policy,
+                            data[0], op.read_buffer, op.size)
+        : writeMessage(m_bus_file, m_address, false, m_retry_policy, data, op.size + 1);
+    if (!status) {
+      // The failing operation is known, but the merged deferred writes are
+      // sent again one by one, to find the register which failed
+      if (op.part_count > 1) {
+        isolateMergedWrite(op, write_data, merged_sizes, queue.size(), status.err_code);
+      }
+      throw I2CTransferException(queue.size(), data[0], op.read_buffer == nullptr,
+                                 status.err_code);
+    }
+  }
+}
+
+} // end of namespace RPiHWCtrl
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2018 Nikolaos Apostolakos <nikoapos@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * @file PwmOutput.cpp
+ * @author Nikolaos Apostolakos <nikoapos@gmail.com>
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono> // for std::chrono_literals
+#include <thread> // for std::this_thread
+#include "RPiHWCtrl/Interfaces/exceptions.h"
+#include <RPiHWCtrl/pwm/PwmOutput.h>
+
+// We introduce the symbols from std::chrono_literals so we can write time
+// like 500ms (500 milliseconds)
+using namespace std::chrono_literals;
+
+namespace RPiHWCtrl {
+
+namespace {
+
+// The maximum time we wait for an exported channel to become ready and the
+// maximum delay between two checks
+constexpr auto ready_timeout = 1s;
+constexpr auto max_ready_delay = 2ms;
+
+// Writes the given string to a sysfs file
+void writeFile(const std::string& path, const std::string& content) {
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw PwmException() << "Failed to open " << path << ": " << std::strerror(errno);
+  }
+  auto written = write(fd, content.c_str(), content.size());
+  int err = errno;
+  close(fd);
+  if (written != static_cast<ssize_t>(content.size())) {
+    throw PwmException() << "Failed to write " << path << ": " << std::strerror(err);
+  }
+}
+
+int openFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    throw PwmException() << "Failed to open " << path << ": " << std::strerror(errno);
+  }
+  return fd;
+}
+
+// Reads the number stored in a sysfs attribute, or zero if it cannot be read
+std::uint64_t readNumber(int fd) {
+  char buffer[32] {};
+  if (pread(fd, buffer, sizeof(buffer) - 1, 0) <= 0) {
+    return 0;
+  }
+  return std::strtoull(buffer, nullptr, 10);
+}
+
+// Writes a number to a sysfs attribute, from the beginning of the file. The
+// number is terminated with a newline, which the kernel accepts, so it is also
+// read back correctly from a regular file which had a longer number before.
+bool writeNumber(int fd, std::uint64_t value) {
+  char buffer[32];
+  int size = std::snprintf(buffer, sizeof(buffer), "%llu\n", (unsigned long long) value);
+  return pwrite(fd, buffer, size, 0) == size;
+}
+
+} // end of anonymous namespace
+
+constexpr const char* PwmOutput::default_sysfs_root;
+
+PwmOutput::PwmOutput(int channel, std::chrono::nanoseconds period, int chip,
+                     const std::string& sysfs_root)
+        : m_channel(channel),
+          m_chip_dir(sysfs_root + "/pwmchip" + std::to_string(chip)) {
+  if (channel < 0) {
+    throw PwmException() << "Bad PWM channel " << channel;
+  }
+  if (period.count() <= 0) {
+    throw PwmException() << "Bad PWM period " << period.count() << "ns";
+  }
+
+  try {
+    // Export the channel, if it is not already exported
+    std::string channel_dir = channelDir();
+    if (access(channel_dir.c_str(), F_OK) != 0) {
+      writeFile(m_chip_dir + "/export", std::to_string(channel));
+      m_exported = true;
+    }
+
+    // As with the GPIOs, udev needs some time to set the permissions of the
+    // files of the new channel, so we retry with an increasing delay
+    std::string period_file = channel_dir + "/period";
+    auto delay = 50us;
+    auto waited = 0us;
+    while (access(period_file.c_str(), W_OK) != 0) {
+      if (waited >= ready_timeout) {
+        throw PwmException() << "Failed to export PWM channel " << channel;
+      }
+      std::this_thread::sleep_for(delay);
+      waited += delay;
+      delay = std::min<std::chrono::microseconds>(delay * 2, max_ready_delay);
+    }
+
+    m_period_fd = openFile(period_file);
+    m_duty_fd = openFile(channel_dir + "/duty_cycle");
+    m_enable_fd = openFile(channel_dir + "/enable");
+
+    // We start from the values the channel already has, so the first update
+    // writes the files in the correct order
+    m_period_ns = readNumber(m_period_fd);
+    m_duty_ns = readNumber(m_duty_fd);
+    m_enabled = readNumber(m_enable_fd) != 0;
+
+    update(period, 0);
+    setEnabled(true);
+
+  } catch (...) {
+    release();
+    throw;
+  }
+}
+
+PwmOutput::~PwmOutput() {
+  release();
+}
+
+void PwmOutput::release() {
+  if (m_enable_fd >= 0) {
+    try {
+      setEnabled(false);
+    } catch (const PwmException&) {
+    }
+  }
+  for (int fd : {m_period_fd, m_duty_fd, m_enable_fd}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  m_period_fd = m_duty_fd = m_enable_fd = -1;
+  // We ignore any errors, as there is nothing we can do about them
+  if (m_exported) {
+    try {
+      writeFile(m_chip_dir + "/unexport", std::to_string(m_channel));
+    } catch (const PwmException&) {
+    }
+    m_exported = false;
+  }
+}
+
+std::string PwmOutput::channelDir() const {
+  return m_chip_dir + "/pwm" + std::to_string(m_channel);
+}
+
+void PwmOutput::writeValue(const double& duty) {
+  update(std::chrono::nanoseconds(m_period_ns), duty);
+}
+
+void PwmOutput::update(std::chrono::nanoseconds period, double duty) {
+  if (period.count() <= 0) {
+    throw PwmException() << "Bad PWM period " << period.count() << "ns";
+  }
+  std::uint64_t period_ns = period.count();
+  std::uint64_t duty_ns = std::min(std::max(duty, 0.), 1.) * period_ns + 0.5;
+
+  // The duty cycle must never be longer than the period. If the period grows
+  // we write it first, otherwise we first shrink the duty cycle.
+  if (period_ns >= m_period_ns) {
+    writePeriod(period_ns);
+    writeDuty(duty_ns);
+  } else {
+    writeDuty(duty_ns);
+    writePeriod(period_ns);
+  }
+}
+
+void PwmOutput::setEnabled(bool enabled) {
+  if (enabled == m_enabled) {
+    return;
+  }
+  if (!writeNumber(m_enable_fd, enabled ? 1 : 0)) {
+    throw PwmException() << "Failed to " << (enabled ? "enable" : "disable")
+                         << " PWM channel " << m_channel << ": " << std::strerror(errno);
+  }
+  m_enabled = enabled;
+}
+
+void PwmOutput::writePeriod(std::uint64_t period_ns) {
+  if (period_ns == m_period_ns) {
+    return;
+  }
+  if (!writeNumber(m_period_fd, period_ns)) {
+    throw PwmException() << "Failed to set the period of PWM channel " << m_channel
+                         << " to " << period_ns << "ns: " << std::strerror(errno);
+  }
+  m_period_ns = period_ns;
+}
+
+void PwmOutput::writeDuty(std::uint64_t duty_ns) {
+  if (duty_ns == m_duty_ns) {
+    return;
+  }
+  if (!writeNumber(m_duty_fd, duty_ns)) {
+    throw PwmException() << "Failed to set the duty cycle of PWM channel " << m_channel
+                         << " to " << duty_ns << "ns: " << std::strerror(errno);
+  }
+  m_duty_ns = duty_ns;
+}
+
+} // end of namespace RPiHWCtrl